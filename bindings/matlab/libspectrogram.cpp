@@ -17,10 +17,10 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     }
 
     // Check input data dimensions
-    const int            rank    = mxGetNumberOfDimensions(prhs[0]);
-    const unsigned long* dims    = mxGetDimensions(prhs[0]);
-    unsigned long        numel   = 1;
-    unsigned long        max_dim = 0;
+    const int     rank    = mxGetNumberOfDimensions(prhs[0]);
+    const mwSize* dims    = mxGetDimensions(prhs[0]);
+    size_t        numel   = 1;
+    size_t        max_dim = 0;
     for (int i = 0; i < rank; i++) {
         numel *= dims[i];
         if (dims[i] > max_dim)
@@ -59,6 +59,7 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     int               buflen, status;
     char*             buffer;
     SpectrogramConfig config;
+    spectrogram_init_config(&config);
 
     // Configuration: Padding Mode
     field  = mxGetField(prhs[1], 0, "padding_mode");
@@ -115,28 +116,28 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     if (!(mxIsDouble(field) & mxIsScalar(field))) {
         mexErrMsgIdAndTxt("libspectrogram:input:badwindowlength", "Invalid window length");
     }
-    config.window_length = (unsigned long)mxGetScalar(field);
+    config.window_length = (size_t)mxGetScalar(field);
 
     // Configuration: Window Overlap
     field = mxGetField(prhs[1], 0, "window_overlap");
     if (!(mxIsDouble(field) & mxIsScalar(field))) {
         mexErrMsgIdAndTxt("libspectrogram:input:badwindowoverlap", "Invalid window overlap");
     }
-    config.window_overlap = (unsigned long)mxGetScalar(field);
+    config.window_overlap = (size_t)mxGetScalar(field);
 
     // Configuration: Window Overlap
     field = mxGetField(prhs[1], 0, "transform_length");
     if (!(mxIsDouble(field) & mxIsScalar(field))) {
         mexErrMsgIdAndTxt("libspectrogram:input:badwindowoverlap", "Invalid transform length");
     }
-    config.transform_length = (unsigned long)mxGetScalar(field);
+    config.transform_length = (size_t)mxGetScalar(field);
 
     // Create the program
     SpectrogramTransform* mySTFT = spectrogram_create(&props, &config);
 
     // Get output parameters
-    unsigned long time_len = spectrogram_get_timelen(mySTFT);
-    unsigned long freq_len = spectrogram_get_freqlen(mySTFT);
+    size_t time_len = spectrogram_get_timelen(mySTFT);
+    size_t freq_len = spectrogram_get_freqlen(mySTFT);
 
     // Create empty output struct
     const char* fnames[4];
@@ -164,6 +165,8 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     // Get the outputs
     spectrogram_get_time(mySTFT, mxGetPr(mxTime));
     spectrogram_get_freq(mySTFT, mxGetPr(mxFreq));
-    spectrogram_get_power(mySTFT, mxGetPr(mxPower));
-    spectrogram_get_phase(mySTFT, mxGetPr(mxPhase));
+    spectrogram_get_power_phase(mySTFT, mxGetPr(mxPower), mxGetPr(mxPhase));
+
+    // Destroy the transform
+    spectrogram_destroy(mySTFT);
 }
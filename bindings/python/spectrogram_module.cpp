@@ -0,0 +1,327 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spectrogram.h"
+
+// Array: a C-contiguous block of memory owned by the extension, exported through the buffer protocol, so that
+// numpy.asarray() and memoryview() wrap it without copying
+typedef struct {
+    PyObject_HEAD
+    void*      data;
+    int        ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+    Py_ssize_t itemsize;
+    char       format[2];
+} Array;
+
+static void Array_dealloc(Array* self) {
+    PyTypeObject* type = Py_TYPE(self);
+    free(self->data);
+    type->tp_free((PyObject*)self);
+    Py_DECREF(type);
+}
+
+static int Array_getbuffer(Array* self, Py_buffer* view, int flags) {
+    Py_ssize_t length = self->itemsize;
+    for (int dim = 0; dim < self->ndim; dim++) {
+        length *= self->shape[dim];
+    }
+
+    if (PyBuffer_FillInfo(view, (PyObject*)self, self->data, length, 0, flags) != 0) {
+        return -1;
+    }
+    // Plain byte buffers unless the consumer asks for the layout
+    if (flags & PyBUF_FORMAT) {
+        view->format   = self->format;
+        view->itemsize = self->itemsize;
+    }
+    if (flags & PyBUF_ND) {
+        view->itemsize = self->itemsize;
+        view->ndim     = self->ndim;
+        view->shape    = self->shape;
+    }
+    if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) {
+        view->strides = self->strides;
+    }
+    return 0;
+}
+
+static PyType_Slot Array_slots[] = {
+    {Py_tp_dealloc, (void*)Array_dealloc},
+    {Py_tp_doc, (void*)"Spectrogram output exported through the buffer protocol"},
+    {Py_bf_getbuffer, (void*)Array_getbuffer},
+    {0, NULL}};
+
+static PyType_Spec Array_spec = {"spectrogram.Array", sizeof(Array), 0, Py_TPFLAGS_DEFAULT, Array_slots};
+
+static PyTypeObject* ArrayType = NULL;
+
+// Allocate an uninitialized array of rows x cols values (rows = 0 for a vector)
+static Array* new_array(Py_ssize_t rows, Py_ssize_t cols, int data_size) {
+    Array* array = PyObject_New(Array, ArrayType);
+    if (!array) {
+        return NULL;
+    }
+
+    array->ndim       = (rows > 0) ? 2 : 1;
+    array->itemsize   = data_size;
+    array->format[0]  = (data_size == sizeof(float)) ? 'f' : 'd';
+    array->format[1]  = '\0';
+    array->shape[0]   = (rows > 0) ? rows : cols;
+    array->shape[1]   = cols;
+    array->strides[0] = (rows > 0) ? cols * data_size : data_size;
+    array->strides[1] = data_size;
+    array->data       = malloc((size_t)((rows > 0) ? rows : 1) * cols * data_size + 1);
+    if (!array->data) {
+        Py_DECREF(array);
+        return (Array*)PyErr_NoMemory();
+    }
+    return array;
+}
+
+// Sample size of a buffer format, or 0 if it is neither float32 nor float64 in native byte order
+static int format_size(const char* format) {
+    if (format[0] == '@' || format[0] == '=' || (format[0] == '<' && PY_LITTLE_ENDIAN) ||
+        (format[0] == '>' && PY_BIG_ENDIAN)) {
+        format++;
+    }
+    if (strcmp(format, "f") == 0) {
+        return sizeof(float);
+    }
+    if (strcmp(format, "d") == 0) {
+        return sizeof(double);
+    }
+    return 0;
+}
+
+static int parse_name(const char* name, const char* const* names, int num_names, const char* what) {
+    for (int index = 0; index < num_names; index++) {
+        if (strcmp(name, names[index]) == 0) {
+            return index;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "Invalid %s: %s", what, name);
+    return -1;
+}
+
+static const char* const kPaddingModes[] = {"TRUNCATE", "PAD"};
+static const char* const kWindowTypes[]  = {"RECTANGULAR", "TRIANGULAR", "BARTLETT",         "HANN",
+                                           "WELCH",       "HAMMING",    "BLACKMAN",         "NUTTALL",
+                                           "BLACKMAN_NUTTALL",          "BLACKMAN_HARRIS"};
+
+// Get a writable output buffer supplied by the caller, checking it holds exactly numel samples of the input type
+static int get_output(PyObject* object, Py_ssize_t numel, int data_size, Py_buffer* view, const char* what) {
+    if (PyObject_GetBuffer(object, view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+        return -1;
+    }
+    if (format_size(view->format) != data_size || view->len != numel * data_size) {
+        PyErr_Format(PyExc_ValueError, "%s must hold %zd values of the signal's type", what, numel);
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+PyDoc_STRVAR(stft_doc,
+             "stft(signal, sample_rate, window_length, window_overlap=0, transform_length=0,\n"
+             "     window_type='RECTANGULAR', padding_mode='TRUNCATE', power=None, phase=None, num_threads=0)\n"
+             "--\n\n"
+             "Compute the spectrogram of a 1-dimensional float32 or float64 buffer, such as a NumPy array,\n"
+             "which may be strided. Signals whose samples are a positive whole number of samples apart are read\n"
+             "in place; reversed, repeated (zero stride) or misaligned views are copied first. The GIL is\n"
+             "released while transforming.\n\n"
+             "Returns a dict of time [T], freq [F], power [T x F] and phase [T x F] arrays of the signal's type,\n"
+             "exported through the buffer protocol (wrap them with numpy.asarray). Writable C-contiguous buffers\n"
+             "passed as power or phase are filled in place and returned instead. transform_length defaults to\n"
+             "window_length.\n\n"
+             "Each call plans its transform with FFTW_ESTIMATE, since the plan is used once: measuring would\n"
+             "take longer than the transform itself.");
+
+static PyObject* stft(PyObject*, PyObject* args, PyObject* kwargs) {
+    static const char* keywords[] = {"signal",       "sample_rate", "window_length", "window_overlap",
+                                     "transform_length", "window_type", "padding_mode", "power",
+                                     "phase",        "num_threads", NULL};
+
+    PyObject*   signal_object;
+    double      sample_rate;
+    Py_ssize_t  window_length, window_overlap = 0, transform_length = 0;
+    const char* window_type  = "RECTANGULAR";
+    const char* padding_mode = "TRUNCATE";
+    PyObject*   power_object = Py_None;
+    PyObject*   phase_object = Py_None;
+    int         num_threads  = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Odn|nnssOOi", (char**)keywords, &signal_object, &sample_rate,
+                                     &window_length, &window_overlap, &transform_length, &window_type,
+                                     &padding_mode, &power_object, &phase_object, &num_threads)) {
+        return NULL;
+    }
+    if (window_length <= 0 || window_overlap < 0 || transform_length < 0 || num_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "Lengths, overlap and thread count must not be negative");
+        return NULL;
+    }
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    const int padding_index = parse_name(padding_mode, kPaddingModes, 2, "padding mode");
+    const int window_index  = parse_name(window_type, kWindowTypes, 10, "window type");
+    if (padding_index < 0 || window_index < 0) {
+        return NULL;
+    }
+    config.padding_mode     = (PaddingMode)padding_index;
+    config.window_type      = (WindowType)window_index;
+    config.window_length    = window_length;
+    config.window_overlap   = window_overlap;
+    config.transform_length = (transform_length > 0) ? transform_length : window_length;
+    config.num_threads      = num_threads;
+    config.planner_rigor    = PLANNER_ESTIMATE;
+
+    // The signal is read in place: its stride in samples becomes the input stride
+    Py_buffer signal;
+    if (PyObject_GetBuffer(signal_object, &signal, PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+        return NULL;
+    }
+
+    SpectrogramInput props;
+    props.sample_rate = sample_rate;
+    props.data_size   = format_size(signal.format);
+    props.num_samples = (signal.ndim == 1) ? signal.shape[0] : 0;
+    props.stride      = 1;
+
+    const char* error = NULL;
+    if (props.data_size == 0) {
+        error = "Signal must be float32 or float64";
+    } else if (signal.ndim != 1) {
+        error = "Signal must be 1-dimensional";
+    }
+    if (error) {
+        PyErr_SetString(PyExc_ValueError, error);
+        PyBuffer_Release(&signal);
+        return NULL;
+    }
+
+    // The signal is read in place when its stride is a positive number of samples. Otherwise (reversed, repeated or
+    // misaligned samples) it is gathered into a contiguous copy, since the input stride cannot express it.
+    void* samples = signal.buf;
+    void* copy    = NULL;
+    if (signal.strides[0] > 0 && signal.strides[0] % props.data_size == 0) {
+        props.stride = signal.strides[0] / props.data_size;
+    } else {
+        copy = malloc(props.num_samples * props.data_size + 1);
+        if (!copy) {
+            PyBuffer_Release(&signal);
+            return PyErr_NoMemory();
+        }
+        for (size_t index = 0; index < props.num_samples; index++) {
+            memcpy((char*)copy + index * props.data_size, (char*)signal.buf + (Py_ssize_t)index * signal.strides[0],
+                   props.data_size);
+        }
+        samples = copy;
+    }
+
+    SpectrogramTransform* transform;
+    Py_BEGIN_ALLOW_THREADS
+    transform = spectrogram_create(&props, &config);
+    Py_END_ALLOW_THREADS
+
+    const Py_ssize_t time_len = spectrogram_get_timelen(transform);
+    const Py_ssize_t freq_len = spectrogram_get_freqlen(transform);
+
+    // Outputs: supplied buffers, or new arrays
+    Py_buffer power_view, phase_view;
+    PyObject* time   = (PyObject*)new_array(0, time_len, props.data_size);
+    PyObject* freq   = (PyObject*)new_array(0, freq_len, props.data_size);
+    PyObject* power  = NULL;
+    PyObject* phase  = NULL;
+    PyObject* result = NULL;
+    bool      failed = !time || !freq;
+
+    if (!failed && power_object != Py_None) {
+        failed = get_output(power_object, time_len * freq_len, props.data_size, &power_view, "power") != 0;
+        if (!failed) {
+            power = power_object;
+            Py_INCREF(power);
+        }
+    } else if (!failed) {
+        power = (PyObject*)new_array(time_len, freq_len, props.data_size);
+        failed = !power;
+        if (!failed) {
+            power_view.buf = ((Array*)power)->data;
+            power_view.obj = NULL;
+        }
+    }
+
+    if (!failed && phase_object != Py_None) {
+        failed = get_output(phase_object, time_len * freq_len, props.data_size, &phase_view, "phase") != 0;
+        if (!failed) {
+            phase = phase_object;
+            Py_INCREF(phase);
+        }
+    } else if (!failed) {
+        phase = (PyObject*)new_array(time_len, freq_len, props.data_size);
+        failed = !phase;
+        if (!failed) {
+            phase_view.buf = ((Array*)phase)->data;
+            phase_view.obj = NULL;
+        }
+    }
+
+    if (!failed) {
+        void* time_data = ((Array*)time)->data;
+        void* freq_data = ((Array*)freq)->data;
+
+        Py_BEGIN_ALLOW_THREADS
+        spectrogram_execute(transform, samples);
+        spectrogram_get_time(transform, time_data);
+        spectrogram_get_freq(transform, freq_data);
+        spectrogram_get_power_phase(transform, power_view.buf, phase_view.buf);
+        Py_END_ALLOW_THREADS
+
+        result = Py_BuildValue("{sOsOsOsO}", "time", time, "freq", freq, "power", power, "phase", phase);
+    }
+
+    if (power && power_object != Py_None) {
+        PyBuffer_Release(&power_view);
+    }
+    if (phase && phase_object != Py_None) {
+        PyBuffer_Release(&phase_view);
+    }
+    Py_XDECREF(time);
+    Py_XDECREF(freq);
+    Py_XDECREF(power);
+    Py_XDECREF(phase);
+    PyBuffer_Release(&signal);
+    free(copy);
+    spectrogram_destroy(transform);
+
+    return result;
+}
+
+static PyMethodDef spectrogram_methods[] = {
+    {"stft", (PyCFunction)(void (*)(void))stft, METH_VARARGS | METH_KEYWORDS, stft_doc}, {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef spectrogram_module = {
+    PyModuleDef_HEAD_INIT, "spectrogram", "Python bindings for libspectrogram", -1, spectrogram_methods, NULL, NULL,
+    NULL, NULL};
+
+PyMODINIT_FUNC PyInit_spectrogram(void) {
+    ArrayType = (PyTypeObject*)PyType_FromSpec(&Array_spec);
+    if (!ArrayType) {
+        return NULL;
+    }
+
+    PyObject* module = PyModule_Create(&spectrogram_module);
+    if (!module) {
+        return NULL;
+    }
+
+    Py_INCREF(ArrayType);
+    if (PyModule_AddObject(module, "Array", (PyObject*)ArrayType) < 0) {
+        Py_DECREF(ArrayType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,94 @@
+"""Tests for the Python bindings, using only the standard library (NumPy arrays go through the same buffer protocol)."""
+import array
+import math
+import sys
+import threading
+import unittest
+
+import spectrogram
+
+
+def noisy_signal(num_samples):
+    return [math.sin(0.3 * i) + 0.5 * math.sin(1.7 * i) + 0.1 * math.cos(0.01 * i * i) for i in range(num_samples)]
+
+
+def flat(values):
+    view = memoryview(values)
+    return view.cast("B").cast(view.format).tolist()
+
+
+CONFIG = dict(sample_rate=100.0, window_length=64, window_overlap=32, window_type="HANN")
+
+
+class TestSpectrogram(unittest.TestCase):
+    def test_shapes_and_types(self):
+        for typecode in "fd":
+            result = spectrogram.stft(array.array(typecode, noisy_signal(1000)), **CONFIG)
+            power = memoryview(result["power"])
+            self.assertEqual(power.format, typecode)
+            self.assertEqual(power.shape, (30, 33))
+            self.assertEqual(memoryview(result["time"]).shape, (30,))
+            self.assertEqual(memoryview(result["freq"]).shape, (33,))
+            self.assertAlmostEqual(memoryview(result["freq"])[-1], 50.0, places=4)
+
+    def test_strided_signal_is_not_copied(self):
+        # Every third sample of an interleaved buffer matches the same samples made contiguous
+        interleaved = array.array("d", noisy_signal(3000))
+        strided = memoryview(interleaved)[1::3]
+        contiguous = array.array("d", strided.tolist())
+
+        expected = spectrogram.stft(contiguous, **CONFIG)
+        result = spectrogram.stft(strided, **CONFIG)
+        self.assertEqual(flat(result["power"]), flat(expected["power"]))
+        self.assertEqual(flat(result["phase"]), flat(expected["phase"]))
+
+    def test_reversed_signal_is_copied(self):
+        signal = array.array("d", noisy_signal(1000))
+        reversed_signal = array.array("d", reversed(signal))
+
+        expected = spectrogram.stft(reversed_signal, **CONFIG)
+        result = spectrogram.stft(memoryview(signal)[::-1], **CONFIG)
+        self.assertEqual(flat(result["power"]), flat(expected["power"]))
+        self.assertEqual(flat(result["phase"]), flat(expected["phase"]))
+
+    def test_preallocated_outputs(self):
+        signal = array.array("d", noisy_signal(1000))
+        expected = spectrogram.stft(signal, **CONFIG)
+
+        power = array.array("d", bytes(30 * 33 * 8))
+        phase = bytearray(30 * 33 * 8)
+        result = spectrogram.stft(signal, power=power, phase=memoryview(phase).cast("d"), **CONFIG)
+        self.assertIs(result["power"], power)
+        self.assertEqual(flat(power), flat(expected["power"]))
+        self.assertEqual(flat(memoryview(phase).cast("d")), flat(expected["phase"]))
+
+        with self.assertRaises(ValueError):
+            spectrogram.stft(signal, power=array.array("d", bytes(8)), **CONFIG)
+        with self.assertRaises(ValueError):
+            spectrogram.stft(signal, power=array.array("f", bytes(30 * 33 * 4)), **CONFIG)
+
+    def test_invalid_signals(self):
+        with self.assertRaises(ValueError):
+            spectrogram.stft(array.array("i", range(100)), **CONFIG)
+        with self.assertRaises(ValueError):
+            spectrogram.stft(array.array("d", noisy_signal(100)), 100.0, 64, window_type="GAUSSIAN")
+
+    def test_concurrent_calls(self):
+        signal = array.array("f", noisy_signal(20000))
+        expected = flat(spectrogram.stft(signal, **CONFIG)["power"])
+        results = [None] * 4
+
+        def run(index):
+            results[index] = flat(spectrogram.stft(signal, **CONFIG)["power"])
+
+        threads = [threading.Thread(target=run, args=(index,)) for index in range(len(results))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        for result in results:
+            self.assertEqual(result, expected)
+
+
+if __name__ == "__main__":
+    sys.exit(unittest.main())
@@ -0,0 +1,145 @@
+#include "spectrogram_client.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include "protocol.h"
+
+#if __GNUC__ >= 4
+#define DLL_PUBLIC __attribute__((visibility("default")))
+#else
+#define DLL_PUBLIC
+#endif
+
+struct SpectrogramClient {
+    int    connection;
+    void*  arena;
+    size_t arena_size;
+};
+
+// Distinguishes the arenas of connections made by the same process
+static std::atomic<unsigned int> arena_counter(0);
+
+// Send one request and wait for its reply
+static ClientStatus transact(SpectrogramClient* client, const Request& request, Reply* reply) {
+    if (!send_message(client->connection, &request, sizeof(request)) ||
+        !receive_message(client->connection, reply, sizeof(*reply))) {
+        return CLIENT_DISCONNECTED;
+    }
+    return (ClientStatus)reply->status;
+}
+
+// Fill the parts of a request describing a job. The tuning file is a pointer into this process, so it is not sent.
+static void describe_job(Request* request, RequestType type, const SpectrogramInput* props,
+                         const SpectrogramConfig* config) {
+    memset(request, 0, sizeof(*request));
+    request->type = type;
+    memcpy(&request->props, props, sizeof(*props));
+    memcpy(&request->config, config, sizeof(*config));
+    request->config.tuning_file = NULL;
+}
+
+DLL_PUBLIC SpectrogramClient* spectrogram_client_connect(const char* socket_path, size_t arena_bytes) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "WARNING: Socket path is too long: %s\n", socket_path);
+        return NULL;
+    }
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+    const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) != 0) {
+        if (connection >= 0) {
+            close(connection);
+        }
+        return NULL;
+    }
+
+    // Create the arena under a name private to this connection
+    Request request;
+    memset(&request, 0, sizeof(request));
+    request.type     = REQUEST_ATTACH;
+    request.shm_size = arena_bytes;
+    snprintf(request.shm_name, kShmNameLength, "/spectrogram-%d-%u", (int)getpid(), arena_counter++);
+
+    void*     arena = MAP_FAILED;
+    const int shm   = shm_open(request.shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm >= 0) {
+        if (ftruncate(shm, arena_bytes) == 0) {
+            arena = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        }
+        close(shm);
+    }
+
+    SpectrogramClient* client = new SpectrogramClient();
+    client->connection        = connection;
+    client->arena             = (arena == MAP_FAILED) ? NULL : arena;
+    client->arena_size        = client->arena ? arena_bytes : 0;
+
+    // Once the daemon has mapped the arena the name is no longer needed, and the memory is released when both ends
+    // unmap it
+    Reply reply;
+    if (!client->arena || transact(client, request, &reply) != CLIENT_OK) {
+        if (shm >= 0) {
+            shm_unlink(request.shm_name);
+        }
+        spectrogram_client_disconnect(client);
+        return NULL;
+    }
+    shm_unlink(request.shm_name);
+
+    return client;
+}
+
+DLL_PUBLIC void* spectrogram_client_arena(SpectrogramClient* client) {
+    return client->arena;
+}
+
+DLL_PUBLIC size_t spectrogram_client_arena_size(SpectrogramClient* client) {
+    return client->arena_size;
+}
+
+DLL_PUBLIC ClientStatus spectrogram_client_query(SpectrogramClient* client, const SpectrogramInput* props,
+                                                 const SpectrogramConfig* config, size_t* timelen, size_t* freqlen) {
+    Request request;
+    Reply   reply;
+    describe_job(&request, REQUEST_QUERY, props, config);
+
+    const ClientStatus status = transact(client, request, &reply);
+    if (status == CLIENT_OK) {
+        *timelen = reply.timelen;
+        *freqlen = reply.freqlen;
+    }
+    return status;
+}
+
+DLL_PUBLIC ClientStatus spectrogram_client_execute(SpectrogramClient* client, const SpectrogramInput* props,
+                                                   const SpectrogramConfig* config, size_t input_offset,
+                                                   size_t power_offset, size_t phase_offset) {
+    Request request;
+    Reply   reply;
+    describe_job(&request, REQUEST_EXECUTE, props, config);
+    request.input_offset = input_offset;
+    request.power_offset = power_offset;
+    request.phase_offset = phase_offset;
+
+    return transact(client, request, &reply);
+}
+
+DLL_PUBLIC void spectrogram_client_disconnect(SpectrogramClient* client) {
+    if (!client) {
+        return;
+    }
+
+    close(client->connection);
+    if (client->arena) {
+        munmap(client->arena, client->arena_size);
+    }
+    delete client;
+}
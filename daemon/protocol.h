@@ -0,0 +1,72 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <cerrno>
+#include <cstdint>
+
+#include "spectrogram.h"
+
+// Messages exchanged over the Unix socket between spectrogramd and its clients. Both ends are built from the same
+// tree and run on the same machine, so the structures are sent as is.
+enum RequestType : uint32_t {
+    REQUEST_ATTACH = 1,  // Map the client's arena, named by shm_name
+    REQUEST_QUERY,       // Report the output dimensions of a configuration
+    REQUEST_EXECUTE      // Transform a signal in the arena and write the outputs back to it
+};
+
+// Length of the arena names, including the terminating null
+static const size_t kShmNameLength = 64;
+
+struct Request {
+    RequestType       type;
+    char              shm_name[kShmNameLength];
+    uint64_t          shm_size;
+    SpectrogramInput  props;
+    SpectrogramConfig config;
+    uint64_t          input_offset;
+    uint64_t          power_offset;
+    uint64_t          phase_offset;
+};
+
+struct Reply {
+    int32_t  status;
+    uint64_t timelen;
+    uint64_t freqlen;
+};
+
+// Send or receive a whole message, retrying short transfers and interruptions. Returns false if the peer is gone.
+static inline bool send_message(int fd, const void* message, size_t length) {
+    const char* bytes = (const char*)message;
+    while (length > 0) {
+        const ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+static inline bool receive_message(int fd, void* message, size_t length) {
+    char* bytes = (char*)message;
+    while (length > 0) {
+        const ssize_t received = recv(fd, bytes, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        length -= received;
+    }
+    return true;
+}
+
+#endif /* PROTOCOL_H */
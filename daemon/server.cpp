@@ -0,0 +1,290 @@
+#include "server.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "protocol.h"
+#include "spectrogram_client.h"
+
+// Whether count elements of the given size starting at the byte offset lie within the arena
+static bool fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t arena_size) {
+    if (offset > arena_size) {
+        return false;
+    }
+    return count == 0 || (element_size > 0 && count <= (arena_size - offset) / element_size);
+}
+
+Server::Server(const std::string& socket_path, const std::string& tuning_file, size_t max_transforms)
+    : socket_path_(socket_path),
+      tuning_file_(tuning_file),
+      max_transforms_(std::max(max_transforms, (size_t)1)),
+      listener_(-1),
+      running_(false) {}
+
+Server::~Server() {
+    stop();
+}
+
+bool Server::start() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "WARNING: Socket path is too long: %s\n", socket_path_.c_str());
+        return false;
+    }
+    strncpy(address.sun_path, socket_path_.c_str(), sizeof(address.sun_path) - 1);
+
+    // A socket left behind by a previous daemon would make bind fail
+    unlink(socket_path_.c_str());
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0 || bind(listener_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener_, 64) != 0) {
+        fprintf(stderr, "WARNING: Could not listen on %s: %s\n", socket_path_.c_str(), strerror(errno));
+        if (listener_ >= 0) {
+            close(listener_);
+            listener_ = -1;
+        }
+        return false;
+    }
+
+    running_  = true;
+    acceptor_ = std::thread(&Server::accept_clients, this);
+    return true;
+}
+
+void Server::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    // Shutting the sockets down wakes the threads blocked on them
+    shutdown(listener_, SHUT_RDWR);
+    acceptor_.join();
+    close(listener_);
+    listener_ = -1;
+    unlink(socket_path_.c_str());
+
+    // Client threads are detached, and remove their connection once they are done with the server
+    {
+        std::unique_lock<std::mutex> lock(connections_mutex_);
+        for (int connection : connections_) {
+            shutdown(connection, SHUT_RDWR);
+        }
+        connections_closed_.wait(lock, [this] { return connections_.empty(); });
+    }
+
+    std::lock_guard<std::mutex> lock(transforms_mutex_);
+    transforms_.clear();
+}
+
+void Server::accept_clients() {
+    while (running_) {
+        const int connection = accept(listener_, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections_.push_back(connection);
+        std::thread(&Server::serve, this, connection).detach();
+    }
+}
+
+// Append the bytes of a field's value to a key
+template <typename T>
+static void append(std::string& key, const T& value) {
+    key.append((const char*)&value, sizeof(value));
+}
+
+// Key of the transform for a job, from the values of the fields which configure it. The structs are not compared
+// whole: their padding bytes hold whatever the caller's stack did, so identical jobs would differ. The tuning file is
+// the server's own.
+static std::string job_key(const SpectrogramInput& props, const SpectrogramConfig& config) {
+    std::string key;
+    append(key, props.sample_rate);
+    append(key, props.num_samples);
+    append(key, props.data_size);
+    append(key, props.stride);
+    append(key, config.padding_mode);
+    append(key, config.window_type);
+    append(key, config.window_length);
+    append(key, config.window_overlap);
+    append(key, config.transform_length);
+    append(key, config.execution_mode);
+    append(key, config.cache_outputs);
+    append(key, config.cache_tiles);
+    append(key, config.max_memory_bytes);
+    append(key, config.planner_rigor);
+    append(key, config.chunk_frames);
+    append(key, config.num_threads);
+    append(key, config.autotune);
+    append(key, config.gate_threshold);
+    append(key, config.gate_floor);
+    append(key, config.rolloff_fraction);
+    append(key, config.decimation);
+    append(key, config.interpolation);
+    append(key, config.detrend);
+    append(key, config.pre_emphasis);
+    append(key, config.bins_per_octave);
+    append(key, config.min_frequency);
+    append(key, config.max_frequency);
+    append(key, config.fft_backend);
+    return key;
+}
+
+// Find a planned transform for the job, or plan one. Planning happens outside the lock so that clients with other
+// configurations are not held up.
+std::shared_ptr<Server::Transform> Server::acquire(const SpectrogramInput& props, const SpectrogramConfig& config) {
+    const std::string key = job_key(props, config);
+
+    {
+        std::lock_guard<std::mutex> lock(transforms_mutex_);
+        for (auto entry = transforms_.begin(); entry != transforms_.end(); ++entry) {
+            if (entry->first == key) {
+                transforms_.splice(transforms_.begin(), transforms_, entry);
+                return entry->second;
+            }
+        }
+    }
+
+    if (props.data_size != sizeof(float) && props.data_size != sizeof(double)) {
+        return NULL;
+    }
+
+    SpectrogramInput  create_props  = props;
+    SpectrogramConfig create_config = config;
+    create_config.tuning_file       = tuning_file_.empty() ? NULL : tuning_file_.c_str();
+
+    std::shared_ptr<Transform> transform(new Transform());
+    try {
+        transform->transform = spectrogram_create(&create_props, &create_config);
+    } catch (...) {
+        return NULL;
+    }
+
+    // Transforms evicted while a job still holds them are destroyed when it finishes
+    std::lock_guard<std::mutex> lock(transforms_mutex_);
+    transforms_.emplace_front(key, transform);
+    if (transforms_.size() > max_transforms_) {
+        transforms_.pop_back();
+    }
+    return transform;
+}
+
+// Answer the requests of one client until it disconnects
+//
+// Jobs run in the client's own workspaces, so clients sharing a transform execute concurrently. The workspaces of the
+// transforms the client used most recently are kept, up to the number of transforms the server keeps.
+void Server::serve(int connection) {
+    void*                                 arena      = NULL;
+    uint64_t                              arena_size = 0;
+    std::list<std::unique_ptr<Workspace>> workspaces;
+    Request                               request;
+
+    while (receive_message(connection, &request, sizeof(request))) {
+        Reply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.status = CLIENT_OK;
+
+        if (request.type == REQUEST_ATTACH) {
+            if (arena) {
+                munmap(arena, arena_size);
+                arena      = NULL;
+                arena_size = 0;
+            }
+
+            request.shm_name[kShmNameLength - 1] = '\0';
+            const int shm = shm_open(request.shm_name, O_RDWR, 0);
+            struct stat info;
+            if (shm >= 0 && fstat(shm, &info) == 0 && (uint64_t)info.st_size >= request.shm_size) {
+                arena = mmap(NULL, request.shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+                if (arena == MAP_FAILED) {
+                    arena = NULL;
+                } else {
+                    arena_size = request.shm_size;
+                }
+            }
+            if (shm >= 0) {
+                close(shm);
+            }
+            reply.status = arena ? CLIENT_OK : CLIENT_DISCONNECTED;
+
+        } else if (request.type == REQUEST_QUERY || request.type == REQUEST_EXECUTE) {
+            std::shared_ptr<Transform> transform = acquire(request.props, request.config);
+
+            if (!transform || !transform->transform) {
+                reply.status = CLIENT_INVALID_CONFIG;
+            } else {
+                reply.timelen = spectrogram_get_timelen(transform->transform);
+                reply.freqlen = spectrogram_get_freqlen(transform->transform);
+            }
+
+            if (reply.status == CLIENT_OK && request.type == REQUEST_EXECUTE) {
+                const SpectrogramInput& props       = request.props;
+                const uint64_t          data_size   = props.data_size;
+                const uint64_t          num_outputs = reply.timelen * reply.freqlen;
+                const uint64_t          span        = (props.num_samples > 0) ? props.num_samples - 1 : 0;
+                const bool              want_power  = request.power_offset != SPECTROGRAM_NO_OUTPUT;
+                const bool              want_phase  = request.phase_offset != SPECTROGRAM_NO_OUTPUT;
+
+                // The last input sample is span * stride samples after the first
+                bool in_bounds = arena && (props.stride == 0 || span <= arena_size / props.stride) &&
+                                 fits(request.input_offset, (props.num_samples > 0) ? span * props.stride + 1 : 0,
+                                      data_size, arena_size);
+                if (want_power) {
+                    in_bounds = in_bounds && fits(request.power_offset, num_outputs, data_size, arena_size);
+                }
+                if (want_phase) {
+                    in_bounds = in_bounds && fits(request.phase_offset, num_outputs, data_size, arena_size);
+                }
+
+                if (!in_bounds) {
+                    reply.status = CLIENT_OUT_OF_BOUNDS;
+                } else {
+                    auto entry = std::find_if(workspaces.begin(), workspaces.end(),
+                                              [&](const std::unique_ptr<Workspace>& held) {
+                                                  return held->transform == transform;
+                                              });
+                    if (entry != workspaces.end()) {
+                        workspaces.splice(workspaces.begin(), workspaces, entry);
+                    } else {
+                        workspaces.emplace_front(new Workspace(transform));
+                        if (workspaces.size() > max_transforms_) {
+                            workspaces.pop_back();
+                        }
+                    }
+
+                    char*                 base      = (char*)arena;
+                    SpectrogramWorkspace* workspace = workspaces.front()->workspace;
+                    spectrogram_execute_workspace(transform->transform, workspace, base + request.input_offset);
+                    spectrogram_workspace_get_power_phase(transform->transform, workspace,
+                                                          want_power ? base + request.power_offset : NULL,
+                                                          want_phase ? base + request.phase_offset : NULL);
+                }
+            }
+        }
+
+        if (!send_message(connection, &reply, sizeof(reply))) {
+            break;
+        }
+    }
+
+    if (arena) {
+        munmap(arena, arena_size);
+    }
+    workspaces.clear();
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    connections_.erase(std::find(connections_.begin(), connections_.end(), connection));
+    close(connection);
+    connections_closed_.notify_all();
+}
@@ -0,0 +1,73 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "spectrogram.h"
+
+// Serves spectrogram jobs to local clients over a Unix socket, computing in place in arenas shared with each client.
+// Transforms are kept planned across jobs and clients, the most recently used first.
+class Server {
+   public:
+    Server(const std::string& socket_path, const std::string& tuning_file, size_t max_transforms);
+    Server(const Server& orig) = delete;
+    Server& operator=(const Server& orig) = delete;
+    ~Server();
+
+    // Start accepting clients in the background. Returns false if the socket could not be bound.
+    bool start();
+
+    // Disconnect all clients and stop accepting new ones
+    void stop();
+
+   private:
+    // A planned transform. Its plans are only read by jobs, which each client runs in a workspace of its own.
+    struct Transform {
+        Transform() : transform(NULL) {}
+        ~Transform() { spectrogram_destroy(transform); }
+
+        SpectrogramTransform* transform;
+    };
+
+    // A client's workspace for a transform, which keeps the transform alive while the client holds it
+    struct Workspace {
+        explicit Workspace(const std::shared_ptr<Transform>& owner)
+            : transform(owner), workspace(spectrogram_workspace_create(owner->transform)) {}
+        Workspace(const Workspace& orig) = delete;
+        Workspace& operator=(const Workspace& orig) = delete;
+        ~Workspace() { spectrogram_workspace_destroy(transform->transform, workspace); }
+
+        std::shared_ptr<Transform> transform;
+        SpectrogramWorkspace*      workspace;
+    };
+
+    std::shared_ptr<Transform> acquire(const SpectrogramInput& props, const SpectrogramConfig& config);
+    void                       accept_clients();
+    void                       serve(int connection);
+
+    std::string socket_path_;
+    std::string tuning_file_;
+    size_t      max_transforms_;
+
+    // Planned transforms, keyed by the values of their input properties and configuration
+    std::mutex                                                     transforms_mutex_;
+    std::list<std::pair<std::string, std::shared_ptr<Transform>>> transforms_;
+
+    // Listening socket and one thread per connected client
+    int                     listener_;
+    std::atomic<bool>       running_;
+    std::thread             acceptor_;
+    std::mutex              connections_mutex_;
+    std::condition_variable connections_closed_;
+    std::vector<int>        connections_;
+};
+
+#endif /* SERVER_H */
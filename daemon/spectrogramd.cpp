@@ -0,0 +1,38 @@
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "server.h"
+
+// Number of planned transforms kept warm unless given on the command line
+static const size_t kDefaultMaxTransforms = 64;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <socket path> [tuning file] [max transforms]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string socket_path    = argv[1];
+    const std::string tuning_file    = (argc > 2) ? argv[2] : "";
+    const size_t      max_transforms = (argc > 3) ? strtoul(argv[3], NULL, 10) : kDefaultMaxTransforms;
+
+    // Termination signals are only taken by sigwait below, never by the server's threads
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    Server server(socket_path, tuning_file, max_transforms);
+    if (!server.start()) {
+        return EXIT_FAILURE;
+    }
+
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server.stop();
+
+    return EXIT_SUCCESS;
+}
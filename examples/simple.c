@@ -17,6 +17,7 @@ int main(int argc, char** argv) {
 
     // Specify the configuration for the transform
     SpectrogramConfig config;
+    spectrogram_init_config(&config);
     config.padding_mode     = TRUNCATE;
     config.window_type      = HAMMING;
     config.window_length    = 6;
@@ -27,8 +28,8 @@ int main(int argc, char** argv) {
     SpectrogramTransform* mySTFT = spectrogram_create(&props, &config);
 
     // Get output parameters
-    unsigned long time_len = spectrogram_get_timelen(mySTFT);
-    unsigned long freq_len = spectrogram_get_freqlen(mySTFT);
+    size_t time_len = spectrogram_get_timelen(mySTFT);
+    size_t freq_len = spectrogram_get_freqlen(mySTFT);
 
     // Allocate outputs
     double* time  = malloc(sizeof(double) * time_len);
@@ -42,8 +43,7 @@ int main(int argc, char** argv) {
     // Get the outputs
     spectrogram_get_time(mySTFT, (void*)time);
     spectrogram_get_freq(mySTFT, (void*)freq);
-    spectrogram_get_power(mySTFT, (void*)power);
-    spectrogram_get_phase(mySTFT, (void*)phase);
+    spectrogram_get_power_phase(mySTFT, (void*)power, (void*)phase);
 
     // Destroy the transform
     spectrogram_destroy(mySTFT);
@@ -0,0 +1,308 @@
+#ifndef SPECTROGRAM_HPP
+#define SPECTROGRAM_HPP
+
+/** @file spectrogram.hpp
+ * @brief Header-only C++11 interface over \ref spectrogram.h "spectrogram.h"
+ *
+ * spectrogram::Transform owns a transform and is move-only. Outputs are written to caller memory passed as
+ * spectrogram::span views, or read in place through read-only views and frame ranges, so nothing is allocated or
+ * copied per call.
+ **/
+
+#include <complex>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "spectrogram.h"
+
+namespace spectrogram {
+
+/**
+ * @brief A non-owning view of contiguous values, like C++20's std::span
+ **/
+template <typename T>
+class span {
+   public:
+    typedef T        element_type;
+    typedef T*       iterator;
+    typedef size_t   size_type;
+    typedef typename std::remove_cv<T>::type value_type;
+
+    span() noexcept : data_(nullptr), size_(0) {}
+    span(T* data, size_t size) noexcept : data_(data), size_(size) {}
+    template <size_t N>
+    span(T (&array)[N]) noexcept : data_(array), size_(N) {}
+
+    /** @brief View a container with contiguous storage, such as std::vector or std::array */
+    template <typename Container,
+              typename = typename std::enable_if<
+                  std::is_convertible<decltype(std::declval<Container&>().data()), T*>::value>::type>
+    span(Container& container) : data_(container.data()), size_(container.size()) {}
+
+    /** @brief View a mutable span as read-only */
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    span(const span<U>& other) noexcept : data_(other.data()), size_(other.size()) {}
+
+    T*       data() const noexcept { return data_; }
+    size_t   size() const noexcept { return size_; }
+    bool     empty() const noexcept { return size_ == 0; }
+    T&       operator[](size_t index) const { return data_[index]; }
+    iterator begin() const noexcept { return data_; }
+    iterator end() const noexcept { return data_ + size_; }
+
+    span subspan(size_t offset, size_t count) const { return span(data_ + offset, count); }
+
+   private:
+    T*     data_;
+    size_t size_;
+};
+
+/**
+ * @brief A configuration with every optional field at its default
+ **/
+inline SpectrogramConfig default_config() {
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    return config;
+}
+
+/**
+ * @brief The Fourier spectrum of one segment, read in place from the transform
+ **/
+template <typename T>
+class Frame {
+   public:
+    Frame(const T* row, SpectraLayout layout, size_t transform_length, size_t num_frequencies, size_t index,
+          T time) noexcept
+        : row_(row), layout_(layout), transform_length_(transform_length), num_frequencies_(num_frequencies),
+          index_(index), time_(time) {}
+
+    /** @brief The index of the segment */
+    size_t index() const noexcept { return index_; }
+
+    /** @brief The time of the segment */
+    T time() const noexcept { return time_; }
+
+    /** @brief The number of frequency bins */
+    size_t size() const noexcept { return num_frequencies_; }
+
+    /** @brief The unscaled complex Fourier (or constant-Q) coefficient of a frequency bin */
+    std::complex<T> operator[](size_t bin) const noexcept {
+        if (layout_ == SPECTRA_CONSTANT_Q) {
+            return std::complex<T>(row_[2 * bin], row_[2 * bin + 1]);
+        }
+        const bool has_imag = bin > 0 && 2 * bin < transform_length_;
+        return std::complex<T>(row_[bin], has_imag ? row_[transform_length_ - bin] : T(0));
+    }
+
+   private:
+    const T*      row_;
+    SpectraLayout layout_;
+    size_t        transform_length_;
+    size_t        num_frequencies_;
+    size_t        index_;
+    T             time_;
+};
+
+/**
+ * @brief The frames of an executed transform, as an input range
+ **/
+template <typename T>
+class FrameRange {
+   public:
+    class iterator {
+       public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Frame<T>                value_type;
+        typedef std::ptrdiff_t          difference_type;
+        typedef const Frame<T>*         pointer;
+        typedef Frame<T>                reference;
+
+        iterator(const FrameRange* range, size_t index) noexcept : range_(range), index_(index) {}
+
+        Frame<T>  operator*() const noexcept { return range_->frame(index_); }
+        iterator& operator++() noexcept {
+            index_++;
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            iterator previous = *this;
+            index_++;
+            return previous;
+        }
+        bool operator==(const iterator& other) const noexcept { return index_ == other.index_; }
+        bool operator!=(const iterator& other) const noexcept { return index_ != other.index_; }
+
+       private:
+        const FrameRange* range_;
+        size_t            index_;
+    };
+
+    FrameRange(const SpectrogramSpectraView& view, size_t num_frequencies, const T* time) noexcept
+        : view_(view), num_frequencies_(num_frequencies), time_(time) {}
+
+    iterator begin() const noexcept { return iterator(this, 0); }
+    iterator end() const noexcept { return iterator(this, view_.num_rows); }
+    size_t   size() const noexcept { return view_.num_rows; }
+
+    Frame<T> frame(size_t index) const noexcept {
+        return Frame<T>((const T*)view_.data + index * view_.row_pitch, view_.layout, view_.row_length,
+                        num_frequencies_, index, time_[index]);
+    }
+
+   private:
+    SpectrogramSpectraView view_;
+    size_t                 num_frequencies_;
+    const T*               time_;
+};
+
+/**
+ * @brief A move-only owner of a transform on float or double signals
+ *
+ * Errors in arguments (such as output spans that are too small) throw std::invalid_argument.
+ **/
+template <typename T>
+class Transform {
+    static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value, "Samples must be float or double");
+
+   public:
+    /**
+     * @brief Create a transform for signals of num_samples values, stride values apart
+     **/
+    Transform(double sample_rate, size_t num_samples, const SpectrogramConfig& config, size_t stride = 1)
+        : transform_(nullptr) {
+        SpectrogramInput props;
+        props.sample_rate = sample_rate;
+        props.num_samples = num_samples;
+        props.data_size   = sizeof(T);
+        props.stride      = stride;
+
+        SpectrogramConfig copy = config;
+        transform_             = spectrogram_create(&props, &copy);
+        num_samples_           = num_samples;
+        stride_                = stride;
+        time_.resize(spectrogram_get_timelen(transform_));
+        freq_.resize(spectrogram_get_freqlen(transform_));
+        spectrogram_get_time(transform_, time_.data());
+        spectrogram_get_freq(transform_, freq_.data());
+    }
+
+    ~Transform() {
+        if (transform_) {
+            spectrogram_destroy(transform_);
+        }
+    }
+
+    Transform(const Transform&) = delete;
+    Transform& operator=(const Transform&) = delete;
+
+    Transform(Transform&& other) noexcept
+        : transform_(other.transform_), num_samples_(other.num_samples_), stride_(other.stride_),
+          time_(std::move(other.time_)), freq_(std::move(other.freq_)) {
+        other.transform_ = nullptr;
+    }
+
+    Transform& operator=(Transform&& other) noexcept {
+        std::swap(transform_, other.transform_);
+        std::swap(num_samples_, other.num_samples_);
+        std::swap(stride_, other.stride_);
+        time_.swap(other.time_);
+        freq_.swap(other.freq_);
+        return *this;
+    }
+
+    /** @brief The underlying C handle, for functions not wrapped here */
+    SpectrogramTransform* handle() const noexcept { return transform_; }
+
+    size_t                timelen() const noexcept { return time_.size(); }
+    size_t                freqlen() const noexcept { return freq_.size(); }
+    const std::vector<T>& time() const noexcept { return time_; }
+    const std::vector<T>& freq() const noexcept { return freq_; }
+
+    /** @brief Compute the STFT of a signal, which must hold num_samples values stride apart */
+    void execute(span<const T> signal) {
+        if (num_samples_ > 0 && signal.size() < (num_samples_ - 1) * stride_ + 1) {
+            throw std::invalid_argument("Signal is shorter than the transform input");
+        }
+        spectrogram_execute(transform_, const_cast<T*>(signal.data()));
+    }
+
+    /** @brief Write the power at each time and frequency */
+    void power(span<T> out) const {
+        check_output(out);
+        power_phase(out, span<T>());
+    }
+
+    /** @brief Write the phase at each time and frequency */
+    void phase(span<T> out) const {
+        check_output(out);
+        power_phase(span<T>(), out);
+    }
+
+    /** @brief Write the power and phase in a single pass. Either span may be empty to skip it. */
+    void power_phase(span<T> power, span<T> phase) const {
+        const size_t numel = timelen() * freqlen();
+        if ((!power.empty() && power.size() < numel) || (!phase.empty() && phase.size() < numel)) {
+            throw std::invalid_argument("Output is smaller than timelen * freqlen");
+        }
+        spectrogram_get_power_phase(transform_, power.empty() ? nullptr : power.data(),
+                                    phase.empty() ? nullptr : phase.data());
+    }
+
+    /** @brief Write the real cepstrum of each segment, at quefrencies of 0 to freqlen - 1 samples */
+    void cepstrum(span<T> out) const {
+        check_output(out);
+        spectrogram_get_cepstrum(transform_, out.data());
+    }
+
+    /** @brief Write the autocorrelation of each windowed segment, at lags of 0 to freqlen - 1 samples */
+    void autocorrelation(span<T> out) const {
+        check_output(out);
+        spectrogram_get_autocorrelation(transform_, out.data());
+    }
+
+    /** @brief Read-only view of the power, valid until the next execution */
+    span<const T> power_view() const {
+        return span<const T>((const T*)spectrogram_get_power_view(transform_), timelen() * freqlen());
+    }
+
+    /** @brief Read-only view of the phase, valid until the next execution */
+    span<const T> phase_view() const {
+        return span<const T>((const T*)spectrogram_get_phase_view(transform_), timelen() * freqlen());
+    }
+
+    /**
+     * @brief The spectrum of each segment, read in place until the next execution
+     *
+     * Transforms limited by config.max_memory_bytes do not hold every spectrum and throw std::logic_error.
+     **/
+    FrameRange<T> frames() const {
+        SpectrogramSpectraView view;
+        spectrogram_get_spectra_view(transform_, &view);
+        if (view.num_rows < timelen()) {
+            throw std::logic_error("Transform does not hold the spectra of every segment");
+        }
+        return FrameRange<T>(view, freqlen(), time_.data());
+    }
+
+   private:
+    void check_output(span<T> out) const {
+        if (out.size() < timelen() * freqlen()) {
+            throw std::invalid_argument("Output is smaller than timelen * freqlen");
+        }
+    }
+
+    SpectrogramTransform* transform_;
+    size_t                num_samples_;
+    size_t                stride_;
+    std::vector<T>        time_;
+    std::vector<T>        freq_;
+};
+
+}  // namespace spectrogram
+
+#endif /* SPECTROGRAM_HPP */
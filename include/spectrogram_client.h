@@ -0,0 +1,104 @@
+#ifndef SPECTROGRAM_CLIENT_H
+#define SPECTROGRAM_CLIENT_H
+
+#include <stddef.h>
+
+#include "spectrogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/**
+ * @file spectrogram_client.h
+ * @brief Client for the spectrogramd worker service
+ *
+ * spectrogramd keeps transforms planned and warm across short-lived client processes. A client shares an arena of
+ * POSIX shared memory with the daemon and submits jobs over a local Unix socket. Signals are read from and results are
+ * written to the arena in place, so only small fixed-size job descriptions go through the socket.
+ */
+
+/**
+ * @brief Offset passed for outputs that are not wanted
+ **/
+#define SPECTROGRAM_NO_OUTPUT ((size_t)-1)
+
+/**
+ * @brief Status returned by client calls
+ **/
+typedef enum {
+    CLIENT_OK = 0,         /**< The job succeeded */
+    CLIENT_DISCONNECTED,   /**< The daemon could not be reached */
+    CLIENT_OUT_OF_BOUNDS,  /**< The input or an output does not fit in the arena */
+    CLIENT_INVALID_CONFIG  /**< The daemon could not create a transform for the configuration */
+} ClientStatus;
+
+struct SpectrogramClient;
+
+/**
+ * @brief The opaque pointer for a connection to the daemon
+ **/
+typedef struct SpectrogramClient SpectrogramClient;
+
+/**
+ * @brief Connect to the daemon and share a new arena with it
+ * @param[in] socket_path The path of the daemon's Unix socket
+ * @param[in] arena_bytes The size of the shared arena
+ * @returns The opaque pointer to the connection, or NULL if the daemon could not be reached
+ **/
+SpectrogramClient* spectrogram_client_connect(const char* socket_path, size_t arena_bytes);
+
+/**
+ * @brief Get the shared arena
+ *
+ * Inputs are placed and outputs are found at byte offsets from the start of the arena.
+ * @param[in] client The opaque pointer to the connection
+ * @returns The start of the arena
+ **/
+void* spectrogram_client_arena(SpectrogramClient* client);
+
+/**
+ * @brief Get the size of the shared arena
+ * @param[in] client The opaque pointer to the connection
+ * @returns The size of the arena in bytes
+ **/
+size_t spectrogram_client_arena_size(SpectrogramClient* client);
+
+/**
+ * @brief Get the output dimensions of a job without executing it
+ * @param[in] client The opaque pointer to the connection
+ * @param[in] props A pointer to the properties of the input signal
+ * @param[in] config A pointer to the configuration of the desired STFT. The tuning file is chosen by the daemon.
+ * @param[out] timelen The number of segments
+ * @param[out] freqlen The number of frequencies
+ * @returns The status of the query
+ **/
+ClientStatus spectrogram_client_query(SpectrogramClient* client, const SpectrogramInput* props,
+                                      const SpectrogramConfig* config, size_t* timelen, size_t* freqlen);
+
+/**
+ * @brief Compute the STFT power and/or phase of a signal in the arena
+ *
+ * Blocks until the outputs have been written to the arena.
+ * @param[in] client The opaque pointer to the connection
+ * @param[in] props A pointer to the properties of the input signal
+ * @param[in] config A pointer to the configuration of the desired STFT. The tuning file is chosen by the daemon.
+ * @param[in] input_offset The byte offset of the signal in the arena
+ * @param[in] power_offset The byte offset of the power in the arena (or SPECTROGRAM_NO_OUTPUT)
+ * @param[in] phase_offset The byte offset of the phase in the arena (or SPECTROGRAM_NO_OUTPUT)
+ * @returns The status of the job
+ **/
+ClientStatus spectrogram_client_execute(SpectrogramClient* client, const SpectrogramInput* props,
+                                        const SpectrogramConfig* config, size_t input_offset, size_t power_offset,
+                                        size_t phase_offset);
+
+/**
+ * @brief Disconnect from the daemon and release the arena
+ * @param[in] client The opaque pointer to the connection
+ **/
+void spectrogram_client_disconnect(SpectrogramClient* client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPECTROGRAM_CLIENT_H */
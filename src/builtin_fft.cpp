@@ -0,0 +1,553 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "fft_backend.h"
+
+// Frames transformed together, interleaved so that every butterfly loop runs across them
+static const size_t kBatchFrames = 8;
+
+// Buffer alignment, for full-width vector loads
+static const size_t kAlignment = 64;
+
+// Complex FFT of one length by self-sorting (Stockham) mixed-radix stages
+//
+// Real and imaginary parts are separate arrays holding `batch` interleaved transforms, element e of transform b at
+// e * batch + b. A stage of radix p splits each transform of length p * m into p transforms of length m, reading
+// elements j + r * m and writing element p * j + u, so the output is in natural order without a bit reversal. Every
+// butterfly applies to the `stride * batch` contiguous values of the innermost loop, which compilers vectorize.
+// Radices 2 to 5 have dedicated butterflies, and other prime factors are transformed directly.
+template <typename T>
+class ComplexFFT {
+   public:
+    explicit ComplexFFT(size_t length);
+
+    // Forward transform in place, using scratch arrays of the same size
+    void forward(T* real, T* imag, T* scratch_real, T* scratch_imag, size_t batch) const;
+
+   private:
+    struct Stage {
+        size_t radix;
+        size_t span;
+        size_t twiddles;
+        size_t roots;
+    };
+
+    // Butterflies of one stage, from (xr, xi) to (yr, yi), inner loops of `width` values
+    void radix2(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const;
+    void radix3(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const;
+    void radix4(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const;
+    void radix5(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const;
+    void generic(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const;
+
+    size_t             length_;
+    std::vector<Stage> stages_;
+
+    // Twiddles of each stage, w^(j u) for u = 1...radix-1 and j < span, and the roots of unity of generic radices
+    std::vector<T> twiddle_real_;
+    std::vector<T> twiddle_imag_;
+    std::vector<T> root_real_;
+    std::vector<T> root_imag_;
+};
+
+template <typename T>
+ComplexFFT<T>::ComplexFFT(size_t length) : length_(length) {
+    size_t remaining = length;
+    size_t factor    = 4;
+
+    while (remaining > 1) {
+        // Fours first, then a two, then odd primes in increasing order
+        if (factor == 4 && remaining % 4 != 0) {
+            factor = 2;
+        }
+        if (factor == 2 && remaining % 2 != 0) {
+            factor = 3;
+        }
+        while (factor > 2 && remaining % factor != 0) {
+            factor += 2;
+        }
+
+        const size_t span  = remaining / factor;
+        const Stage  stage = {factor, span, twiddle_real_.size(), root_real_.size()};
+        stages_.push_back(stage);
+
+        for (size_t u = 1; u < factor; u++) {
+            for (size_t j = 0; j < span; j++) {
+                const double angle = -2.0 * M_PI * (double)(j * u) / (double)remaining;
+                twiddle_real_.push_back((T)cos(angle));
+                twiddle_imag_.push_back((T)sin(angle));
+            }
+        }
+        if (factor > 5) {
+            for (size_t k = 0; k < factor; k++) {
+                root_real_.push_back((T)cos(-2.0 * M_PI * k / factor));
+                root_imag_.push_back((T)sin(-2.0 * M_PI * k / factor));
+            }
+        }
+        remaining = span;
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::forward(T* real, T* imag, T* scratch_real, T* scratch_imag, size_t batch) const {
+    T*     xr     = real;
+    T*     xi     = imag;
+    T*     yr     = scratch_real;
+    T*     yi     = scratch_imag;
+    size_t stride = 1;
+
+    for (const Stage& stage : stages_) {
+        const size_t width = stride * batch;
+        switch (stage.radix) {
+            case 2:
+                radix2(stage, xr, xi, yr, yi, width);
+                break;
+            case 3:
+                radix3(stage, xr, xi, yr, yi, width);
+                break;
+            case 4:
+                radix4(stage, xr, xi, yr, yi, width);
+                break;
+            case 5:
+                radix5(stage, xr, xi, yr, yi, width);
+                break;
+            default:
+                generic(stage, xr, xi, yr, yi, width);
+                break;
+        }
+        std::swap(xr, yr);
+        std::swap(xi, yi);
+        stride *= stage.radix;
+    }
+
+    if (xr != real) {
+        std::copy(xr, xr + length_ * batch, real);
+        std::copy(xi, xi + length_ * batch, imag);
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::radix2(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const {
+    const size_t m   = stage.span;
+    const T*     w1r = twiddle_real_.data() + stage.twiddles;
+    const T*     w1i = twiddle_imag_.data() + stage.twiddles;
+
+    for (size_t j = 0; j < m; j++) {
+        const T* x0r = xr + width * j;
+        const T* x0i = xi + width * j;
+        const T* x1r = xr + width * (j + m);
+        const T* x1i = xi + width * (j + m);
+        T*       y0r = yr + width * 2 * j;
+        T*       y0i = yi + width * 2 * j;
+        T*       y1r = y0r + width;
+        T*       y1i = y0i + width;
+        const T  wr  = w1r[j];
+        const T  wi  = w1i[j];
+
+        for (size_t q = 0; q < width; q++) {
+            const T dr = x0r[q] - x1r[q];
+            const T di = x0i[q] - x1i[q];
+            y0r[q]     = x0r[q] + x1r[q];
+            y0i[q]     = x0i[q] + x1i[q];
+            y1r[q]     = dr * wr - di * wi;
+            y1i[q]     = dr * wi + di * wr;
+        }
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::radix3(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const {
+    const size_t m          = stage.span;
+    const T*     twr        = twiddle_real_.data() + stage.twiddles;
+    const T*     twi        = twiddle_imag_.data() + stage.twiddles;
+    const T      half_sqrt3 = (T)(sqrt(3.0) / 2.0);
+
+    for (size_t j = 0; j < m; j++) {
+        const T* x0r = xr + width * j;
+        const T* x0i = xi + width * j;
+        const T* x1r = xr + width * (j + m);
+        const T* x1i = xi + width * (j + m);
+        const T* x2r = xr + width * (j + 2 * m);
+        const T* x2i = xi + width * (j + 2 * m);
+        T*       y0r = yr + width * 3 * j;
+        T*       y0i = yi + width * 3 * j;
+        T*       y1r = y0r + width;
+        T*       y1i = y0i + width;
+        T*       y2r = y1r + width;
+        T*       y2i = y1i + width;
+        const T  w1r = twr[j], w1i = twi[j];
+        const T  w2r = twr[m + j], w2i = twi[m + j];
+
+        for (size_t q = 0; q < width; q++) {
+            const T sr = x1r[q] + x2r[q];
+            const T si = x1i[q] + x2i[q];
+            const T cr = x0r[q] - (T)0.5 * sr;
+            const T ci = x0i[q] - (T)0.5 * si;
+
+            // (x1 - x2) * -i sqrt(3) / 2
+            const T rr = half_sqrt3 * (x1i[q] - x2i[q]);
+            const T ri = half_sqrt3 * (x2r[q] - x1r[q]);
+
+            const T a1r = cr + rr, a1i = ci + ri;
+            const T a2r = cr - rr, a2i = ci - ri;
+            y0r[q]      = x0r[q] + sr;
+            y0i[q]      = x0i[q] + si;
+            y1r[q]      = a1r * w1r - a1i * w1i;
+            y1i[q]      = a1r * w1i + a1i * w1r;
+            y2r[q]      = a2r * w2r - a2i * w2i;
+            y2i[q]      = a2r * w2i + a2i * w2r;
+        }
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::radix4(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const {
+    const size_t m   = stage.span;
+    const T*     twr = twiddle_real_.data() + stage.twiddles;
+    const T*     twi = twiddle_imag_.data() + stage.twiddles;
+
+    for (size_t j = 0; j < m; j++) {
+        const T* x0r = xr + width * j;
+        const T* x0i = xi + width * j;
+        const T* x1r = xr + width * (j + m);
+        const T* x1i = xi + width * (j + m);
+        const T* x2r = xr + width * (j + 2 * m);
+        const T* x2i = xi + width * (j + 2 * m);
+        const T* x3r = xr + width * (j + 3 * m);
+        const T* x3i = xi + width * (j + 3 * m);
+        T*       y0r = yr + width * 4 * j;
+        T*       y0i = yi + width * 4 * j;
+        T*       y1r = y0r + width;
+        T*       y1i = y0i + width;
+        T*       y2r = y1r + width;
+        T*       y2i = y1i + width;
+        T*       y3r = y2r + width;
+        T*       y3i = y2i + width;
+        const T  w1r = twr[j], w1i = twi[j];
+        const T  w2r = twr[m + j], w2i = twi[m + j];
+        const T  w3r = twr[2 * m + j], w3i = twi[2 * m + j];
+
+        for (size_t q = 0; q < width; q++) {
+            const T t0r = x0r[q] + x2r[q], t0i = x0i[q] + x2i[q];
+            const T t1r = x0r[q] - x2r[q], t1i = x0i[q] - x2i[q];
+            const T t2r = x1r[q] + x3r[q], t2i = x1i[q] + x3i[q];
+
+            // (x1 - x3) * -i
+            const T t3r = x1i[q] - x3i[q], t3i = x3r[q] - x1r[q];
+
+            const T a1r = t1r + t3r, a1i = t1i + t3i;
+            const T a2r = t0r - t2r, a2i = t0i - t2i;
+            const T a3r = t1r - t3r, a3i = t1i - t3i;
+            y0r[q]      = t0r + t2r;
+            y0i[q]      = t0i + t2i;
+            y1r[q]      = a1r * w1r - a1i * w1i;
+            y1i[q]      = a1r * w1i + a1i * w1r;
+            y2r[q]      = a2r * w2r - a2i * w2i;
+            y2i[q]      = a2r * w2i + a2i * w2r;
+            y3r[q]      = a3r * w3r - a3i * w3i;
+            y3i[q]      = a3r * w3i + a3i * w3r;
+        }
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::radix5(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const {
+    const size_t m   = stage.span;
+    const T*     twr = twiddle_real_.data() + stage.twiddles;
+    const T*     twi = twiddle_imag_.data() + stage.twiddles;
+    const T      c1  = (T)cos(2.0 * M_PI / 5.0);
+    const T      c2  = (T)cos(4.0 * M_PI / 5.0);
+    const T      s1  = (T)sin(2.0 * M_PI / 5.0);
+    const T      s2  = (T)sin(4.0 * M_PI / 5.0);
+
+    for (size_t j = 0; j < m; j++) {
+        const T* x0r = xr + width * j;
+        const T* x0i = xi + width * j;
+        const T* x1r = xr + width * (j + m);
+        const T* x1i = xi + width * (j + m);
+        const T* x2r = xr + width * (j + 2 * m);
+        const T* x2i = xi + width * (j + 2 * m);
+        const T* x3r = xr + width * (j + 3 * m);
+        const T* x3i = xi + width * (j + 3 * m);
+        const T* x4r = xr + width * (j + 4 * m);
+        const T* x4i = xi + width * (j + 4 * m);
+        T*       y0r = yr + width * 5 * j;
+        T*       y0i = yi + width * 5 * j;
+        const T  w1r = twr[j], w1i = twi[j];
+        const T  w2r = twr[m + j], w2i = twi[m + j];
+        const T  w3r = twr[2 * m + j], w3i = twi[2 * m + j];
+        const T  w4r = twr[3 * m + j], w4i = twi[3 * m + j];
+
+        for (size_t q = 0; q < width; q++) {
+            const T b1r = x1r[q] + x4r[q], b1i = x1i[q] + x4i[q];
+            const T b2r = x2r[q] + x3r[q], b2i = x2i[q] + x3i[q];
+            const T d1r = x1r[q] - x4r[q], d1i = x1i[q] - x4i[q];
+            const T d2r = x2r[q] - x3r[q], d2i = x2i[q] - x3i[q];
+
+            // Outputs 1 and 4, then 2 and 3, are a common real part plus and minus -i times an odd part
+            const T e1r = x0r[q] + c1 * b1r + c2 * b2r, e1i = x0i[q] + c1 * b1i + c2 * b2i;
+            const T e2r = x0r[q] + c2 * b1r + c1 * b2r, e2i = x0i[q] + c2 * b1i + c1 * b2i;
+            const T o1r = s1 * d1r + s2 * d2r, o1i = s1 * d1i + s2 * d2i;
+            const T o2r = s2 * d1r - s1 * d2r, o2i = s2 * d1i - s1 * d2i;
+
+            const T a1r = e1r + o1i, a1i = e1i - o1r;
+            const T a4r = e1r - o1i, a4i = e1i + o1r;
+            const T a2r = e2r + o2i, a2i = e2i - o2r;
+            const T a3r = e2r - o2i, a3i = e2i + o2r;
+
+            y0r[q]             = x0r[q] + b1r + b2r;
+            y0i[q]             = x0i[q] + b1i + b2i;
+            y0r[q + width]     = a1r * w1r - a1i * w1i;
+            y0i[q + width]     = a1r * w1i + a1i * w1r;
+            y0r[q + 2 * width] = a2r * w2r - a2i * w2i;
+            y0i[q + 2 * width] = a2r * w2i + a2i * w2r;
+            y0r[q + 3 * width] = a3r * w3r - a3i * w3i;
+            y0i[q + 3 * width] = a3r * w3i + a3i * w3r;
+            y0r[q + 4 * width] = a4r * w4r - a4i * w4i;
+            y0i[q + 4 * width] = a4r * w4i + a4i * w4r;
+        }
+    }
+}
+
+template <typename T>
+void ComplexFFT<T>::generic(const Stage& stage, const T* xr, const T* xi, T* yr, T* yi, size_t width) const {
+    const size_t p   = stage.radix;
+    const size_t m   = stage.span;
+    const T*     twr = twiddle_real_.data() + stage.twiddles;
+    const T*     twi = twiddle_imag_.data() + stage.twiddles;
+    const T*     rr  = root_real_.data() + stage.roots;
+    const T*     ri  = root_imag_.data() + stage.roots;
+
+    for (size_t j = 0; j < m; j++) {
+        for (size_t u = 0; u < p; u++) {
+            T*      outr = yr + width * (p * j + u);
+            T*      outi = yi + width * (p * j + u);
+            const T wr   = (u == 0) ? (T)1.0 : twr[(u - 1) * m + j];
+            const T wi   = (u == 0) ? (T)0.0 : twi[(u - 1) * m + j];
+
+            std::fill(outr, outr + width, (T)0.0);
+            std::fill(outi, outi + width, (T)0.0);
+            for (size_t r = 0; r < p; r++) {
+                const T* inr = xr + width * (j + r * m);
+                const T* ini = xi + width * (j + r * m);
+                const T  cr  = rr[(r * u) % p];
+                const T  ci  = ri[(r * u) % p];
+                for (size_t q = 0; q < width; q++) {
+                    outr[q] += inr[q] * cr - ini[q] * ci;
+                    outi[q] += inr[q] * ci + ini[q] * cr;
+                }
+            }
+            for (size_t q = 0; q < width; q++) {
+                const T ar = outr[q];
+                outr[q]    = ar * wr - outi[q] * wi;
+                outi[q]    = ar * wi + outi[q] * wr;
+            }
+        }
+    }
+}
+
+// Real and imaginary parts of a batch of complex transforms, and the stage scratch arrays of the same size
+static size_t scratch_values(size_t length, size_t num_frames) {
+    const size_t complex_length = (length % 2 == 0) ? length / 2 : length;
+    return 4 * complex_length * std::min(kBatchFrames, num_frames);
+}
+
+// Batched real transforms in FFTW's half-complex layout
+//
+// Even lengths pack each frame's even and odd samples as the real and imaginary parts of a complex transform of half
+// the length, and separate their spectra in one pass; the inverse reverses both steps. Odd lengths are transformed as
+// complex frames with zero imaginary parts. Inverse transforms use the forward one on conjugated values.
+template <typename T>
+class BuiltinPlan : public FFTPlan<T> {
+   public:
+    explicit BuiltinPlan(const FFTBackend::PlanConfig& config)
+        : length_(config.length), num_frames_(config.num_frames), kind_(config.kind),
+          complex_length_((length_ % 2 == 0) ? length_ / 2 : length_), fft_(complex_length_) {
+        if (length_ % 2 == 0) {
+            for (size_t k = 0; k < complex_length_; k++) {
+                rotation_real_.push_back((T)cos(-2.0 * M_PI * k / length_));
+                rotation_imag_.push_back((T)sin(-2.0 * M_PI * k / length_));
+            }
+        }
+    }
+
+    void execute(T* block) const override {
+        std::vector<T> scratch(scratch_size());
+        execute_with_scratch(block, scratch.data());
+    }
+
+    size_t scratch_size() const override { return scratch_values(length_, num_frames_); }
+
+    void execute_with_scratch(T* block, T* scratch) const override {
+        const size_t values = scratch_size() / 4;
+        T*           real   = scratch;
+        T*           imag   = real + values;
+
+        for (size_t first = 0; first < num_frames_; first += kBatchFrames) {
+            const size_t batch  = std::min(kBatchFrames, num_frames_ - first);
+            T*           frames = block + first * length_;
+
+            if (kind_ == FFT_FORWARD) {
+                pack_forward(frames, batch, real, imag);
+                fft_.forward(real, imag, real + 2 * values, imag + 2 * values, batch);
+                unpack_forward(real, imag, batch, frames);
+            } else {
+                pack_inverse(frames, batch, real, imag);
+                fft_.forward(real, imag, real + 2 * values, imag + 2 * values, batch);
+                unpack_inverse(real, imag, batch, frames);
+            }
+        }
+    }
+
+   private:
+    void pack_forward(const T* frames, size_t batch, T* real, T* imag) const {
+        const bool even = length_ % 2 == 0;
+
+        for (size_t b = 0; b < batch; b++) {
+            const T* frame = frames + b * length_;
+            for (size_t k = 0; k < complex_length_; k++) {
+                real[k * batch + b] = even ? frame[2 * k] : frame[k];
+                imag[k * batch + b] = even ? frame[2 * k + 1] : (T)0.0;
+            }
+        }
+    }
+
+    // X[k] = E[k] + W^k O[k], where E and O are the spectra of the even and odd samples:
+    // E[k] = (Z[k] + conj(Z[n - k])) / 2 and O[k] = -i (Z[k] - conj(Z[n - k])) / 2
+    void unpack_forward(const T* real, const T* imag, size_t batch, T* frames) const {
+        const size_t n = complex_length_;
+
+        for (size_t b = 0; b < batch; b++) {
+            T* frame = frames + b * length_;
+
+            if (length_ % 2 != 0) {
+                frame[0] = real[b];
+                for (size_t k = 1; 2 * k < length_; k++) {
+                    frame[k]           = real[k * batch + b];
+                    frame[length_ - k] = imag[k * batch + b];
+                }
+                continue;
+            }
+
+            frame[0] = real[b] + imag[b];
+            frame[n] = real[b] - imag[b];
+            for (size_t k = 1; 2 * k <= n; k++) {
+                const T zr = real[k * batch + b], zi = imag[k * batch + b];
+                const T cr = real[(n - k) * batch + b], ci = -imag[(n - k) * batch + b];
+                const T er = (T)0.5 * (zr + cr), ei = (T)0.5 * (zi + ci);
+                const T orr = (T)0.5 * (zi - ci), oi = (T)-0.5 * (zr - cr);
+                const T wr = rotation_real_[k], wi = rotation_imag_[k];
+                const T rr = wr * orr - wi * oi, ri = wr * oi + wi * orr;
+
+                // X[n - k] = conj(E[k]) - conj(W^k O[k]), since W^(n - k) = -conj(W^k)
+                frame[k]               = er + rr;
+                frame[length_ - k]     = ei + ri;
+                frame[n - k]           = er - rr;
+                frame[length_ - n + k] = ri - ei;
+            }
+        }
+    }
+
+    // Conjugated inputs of the complex transform: conj(Z[k]) with Z[k] = 2 E[k] + 2i O[k], where
+    // 2 E[k] = X[k] + conj(X[n - k]) and 2 O[k] = (X[k] - conj(X[n - k])) conj(W^k). (yr, yi) is X[n - k].
+    void pack_inverse(const T* frames, size_t batch, T* real, T* imag) const {
+        const size_t n = complex_length_;
+
+        for (size_t b = 0; b < batch; b++) {
+            const T* frame = frames + b * length_;
+
+            if (length_ % 2 != 0) {
+                real[b] = frame[0];
+                imag[b] = (T)0.0;
+                for (size_t k = 1; 2 * k < length_; k++) {
+                    real[k * batch + b]             = frame[k];
+                    imag[k * batch + b]             = -frame[length_ - k];
+                    real[(length_ - k) * batch + b] = frame[k];
+                    imag[(length_ - k) * batch + b] = frame[length_ - k];
+                }
+                continue;
+            }
+
+            for (size_t k = 0; k < n; k++) {
+                const T xr = frame[k], xi = (k == 0) ? (T)0.0 : frame[length_ - k];
+                const T yr = frame[n - k], yi = (k == 0) ? (T)0.0 : frame[length_ - n + k];
+                const T er = xr + yr, ei = xi - yi;
+                const T dr = xr - yr, di = xi + yi;
+                const T wr = rotation_real_[k], wi = -rotation_imag_[k];
+                const T orr = dr * wr - di * wi, oi = dr * wi + di * wr;
+
+                real[k * batch + b] = er - oi;
+                imag[k * batch + b] = -(ei + orr);
+            }
+        }
+    }
+
+    // The transform of the conjugated inputs is the conjugate of the inverse
+    void unpack_inverse(const T* real, const T* imag, size_t batch, T* frames) const {
+        for (size_t b = 0; b < batch; b++) {
+            T* frame = frames + b * length_;
+
+            if (length_ % 2 != 0) {
+                for (size_t k = 0; k < length_; k++) {
+                    frame[k] = real[k * batch + b];
+                }
+                continue;
+            }
+
+            for (size_t k = 0; k < complex_length_; k++) {
+                frame[2 * k]     = real[k * batch + b];
+                frame[2 * k + 1] = -imag[k * batch + b];
+            }
+        }
+    }
+
+    size_t         length_;
+    size_t         num_frames_;
+    FFTKind        kind_;
+    size_t         complex_length_;
+    ComplexFFT<T>  fft_;
+    std::vector<T> rotation_real_;
+    std::vector<T> rotation_imag_;
+};
+
+// Dependency-free backend, always built
+class BuiltinBackend : public FFTBackend {
+   public:
+    FFTBackendType type() const override { return FFT_BACKEND_BUILTIN; }
+
+    std::unique_ptr<FFTPlan<float>> plan(const PlanConfig& config, float*) const override {
+        return std::unique_ptr<FFTPlan<float>>(new BuiltinPlan<float>(config));
+    }
+
+    std::unique_ptr<FFTPlan<double>> plan(const PlanConfig& config, double*) const override {
+        return std::unique_ptr<FFTPlan<double>>(new BuiltinPlan<double>(config));
+    }
+
+    size_t scratch_size(const PlanConfig& config) const override {
+        return scratch_values(config.length, config.num_frames);
+    }
+
+    // Over-allocate and keep the address to free just before the aligned block
+    void* allocate(size_t bytes) const override {
+        void* base = malloc(bytes + kAlignment);
+        if (!base) {
+            return NULL;
+        }
+        void** aligned = (void**)(((uintptr_t)base + kAlignment) & ~(uintptr_t)(kAlignment - 1));
+        aligned[-1]    = base;
+        return aligned;
+    }
+
+    void release(void* buffer) const override {
+        if (buffer) {
+            free(((void**)buffer)[-1]);
+        }
+    }
+};
+
+const FFTBackend* FFTBackend::builtin() {
+    static const BuiltinBackend backend;
+    return &backend;
+}
@@ -0,0 +1,142 @@
+#include "constant_q.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+// Spectral weights smaller than this fraction of a bin's largest weight are dropped
+static const double kKernelThreshold = 1e-3;
+
+// Weights are evaluated within this many Hann main lobe half-widths of each bin's centre
+static const double kKernelSpan = 2.0;
+
+bool ConstantQKernel::Config::operator<(const Config& other) const {
+    return std::tie(sample_rate, transform_length, window_length, bins_per_octave, min_frequency, num_bins) <
+           std::tie(other.sample_rate, other.transform_length, other.window_length, other.bins_per_octave,
+                    other.min_frequency, other.num_bins);
+}
+
+std::shared_ptr<const ConstantQKernel> ConstantQKernel::get(const Config& config) {
+    static std::mutex                                             cache_mutex;
+    static std::map<Config, std::weak_ptr<const ConstantQKernel>> cache;
+    std::lock_guard<std::mutex>                                   lock(cache_mutex);
+
+    // Forget the kernels no transform holds any more
+    for (auto entry = cache.begin(); entry != cache.end();) {
+        entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+    }
+
+    std::shared_ptr<const ConstantQKernel> kernel = cache[config].lock();
+    if (!kernel) {
+        kernel        = std::make_shared<const ConstantQKernel>(config);
+        cache[config] = kernel;
+    }
+    return kernel;
+}
+
+size_t ConstantQKernel::count_bins(size_t bins_per_octave, double min_frequency, double max_frequency) {
+    if (min_frequency <= 0.0 || max_frequency < min_frequency) {
+        return 0;
+    }
+    return (size_t)floor(bins_per_octave * log2(max_frequency / min_frequency) + 1e-9) + 1;
+}
+
+double ConstantQKernel::quality(size_t bins_per_octave) {
+    return 1.0 / (pow(2.0, 1.0 / bins_per_octave) - 1.0);
+}
+
+ConstantQKernel::ConstantQKernel(const Config& config) : transform_length_(config.transform_length) {
+    const size_t length  = config.transform_length;
+    const double quality = ConstantQKernel::quality(config.bins_per_octave);
+
+    frequencies_.resize(config.num_bins);
+    offsets_.assign(1, 0);
+
+    std::vector<double>                                  window;
+    std::vector<std::pair<size_t, std::complex<double>>> candidates;
+
+    for (size_t bin = 0; bin < config.num_bins; bin++) {
+        const double frequency = config.min_frequency * pow(2.0, (double)bin / config.bins_per_octave);
+        frequencies_[bin]      = frequency;
+
+        // Hann window of Q cycles, shortened to the segment if need be, and centred in it
+        const size_t cycles_length = (size_t)ceil(quality * config.sample_rate / frequency);
+        const size_t kernel_length = std::max(std::min(config.window_length, cycles_length), (size_t)2);
+        const size_t start         = (config.window_length - kernel_length) / 2;
+        double       window_sum    = 0.0;
+
+        window.resize(kernel_length);
+        for (size_t n = 0; n < kernel_length; n++) {
+            window[n] = 0.5 - 0.5 * cos(2.0 * M_PI * n / (kernel_length - 1));
+            window_sum += window[n];
+        }
+
+        // Fourier transform of the kernel near its centre: sum_n w[n] exp(j omega n) exp(-2 pi j k (start + n) / N)
+        const double omega   = 2.0 * M_PI * frequency / config.sample_rate;
+        const double centre  = frequency * length / config.sample_rate;
+        const double span    = kKernelSpan * 2.0 * length / kernel_length + 1.0;
+        const size_t first   = (size_t)std::max(0.0, floor(centre - span));
+        const size_t last    = std::min((size_t)ceil(centre + span), length / 2);
+        double       largest = 0.0;
+
+        candidates.clear();
+        for (size_t k = first; k <= last; k++) {
+            const std::complex<double> rotation = std::polar(1.0, omega - 2.0 * M_PI * k / length);
+            std::complex<double>       phasor(1.0, 0.0);
+            std::complex<double>       sum(0.0, 0.0);
+            for (size_t n = 0; n < kernel_length; n++) {
+                sum += window[n] * phasor;
+                phasor *= rotation;
+            }
+
+            const std::complex<double> value =
+                sum * std::polar(1.0 / window_sum, -2.0 * M_PI * (double)((k * start) % length) / length);
+            candidates.emplace_back(k, value);
+            largest = std::max(largest, std::abs(value));
+        }
+
+        // Correlating with the kernel is (1 / N) sum_k X[k] conj(K[k]) over the spectrum
+        for (const std::pair<size_t, std::complex<double>>& candidate : candidates) {
+            if (std::abs(candidate.second) >= kKernelThreshold * largest) {
+                bins_.push_back(candidate.first);
+                weights_.push_back(std::conj(candidate.second) / (double)length);
+            }
+        }
+        offsets_.push_back(bins_.size());
+    }
+
+    // The coefficients are written over the start of each row
+    assert(2 * num_bins() <= transform_length_);
+}
+
+template <typename T>
+void ConstantQKernel::apply(T* block, size_t num_rows, double* coefficients) const {
+    const size_t last_complex = (transform_length_ - 1) / 2;
+
+    for (size_t row = 0; row < num_rows; row++) {
+        T* spectrum = block + row * transform_length_;
+
+        for (size_t bin = 0; bin < num_bins(); bin++) {
+            double real = 0.0;
+            double imag = 0.0;
+            for (size_t entry = offsets_[bin]; entry < offsets_[bin + 1]; entry++) {
+                const size_t                k      = bins_[entry];
+                const std::complex<double>& weight = weights_[entry];
+                const double                re     = spectrum[k];
+                const double im = (k > 0 && k <= last_complex) ? spectrum[transform_length_ - k] : 0.0;
+
+                real += re * weight.real() - im * weight.imag();
+                imag += re * weight.imag() + im * weight.real();
+            }
+            coefficients[2 * bin]     = real;
+            coefficients[2 * bin + 1] = imag;
+        }
+
+        std::copy(coefficients, coefficients + 2 * num_bins(), spectrum);
+    }
+}
+template void ConstantQKernel::apply<float>(float*, size_t, double*) const;
+template void ConstantQKernel::apply<double>(double*, size_t, double*) const;
@@ -0,0 +1,58 @@
+#ifndef CONSTANT_Q_H
+#define CONSTANT_Q_H
+
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Sparse spectral kernel of a constant-Q transform (Brown and Puckette, 1992)
+//
+// Bin k is centred on min_frequency * 2^(k / bins_per_octave), and correlates the signal with a Hann-windowed complex
+// exponential of Q cycles, centred in the segment. By Parseval's theorem the correlation is a weighted sum of the
+// segment's Fourier spectrum, and the weights are negligible away from the bin's centre, so only those above a
+// threshold are kept. Kernels depend only on the configuration and are shared between transforms.
+class ConstantQKernel {
+   public:
+    struct Config {
+        double sample_rate;
+        size_t transform_length;
+        size_t window_length;
+        size_t bins_per_octave;
+        double min_frequency;
+        size_t num_bins;
+
+        bool operator<(const Config& other) const;
+    };
+
+    // The kernel for a configuration, built on first use and kept while any transform holds it
+    static std::shared_ptr<const ConstantQKernel> get(const Config& config);
+
+    // Number of bins from min_frequency up to max_frequency
+    static size_t count_bins(size_t bins_per_octave, double min_frequency, double max_frequency);
+
+    // Ratio of each bin's centre frequency to its bandwidth
+    static double quality(size_t bins_per_octave);
+
+    size_t num_bins() const { return frequencies_.size(); }
+    size_t num_entries() const { return bins_.size(); }
+
+    const std::vector<double>& frequencies() const { return frequencies_; }
+
+    // Replace the half-complex spectra of consecutive segments with their constant-Q coefficients, interleaved as
+    // real and imaginary parts at the start of each row. Each row's coefficients are accumulated in the caller's
+    // scratch of 2 * num_bins() values, since the spectrum is read until the last one is done.
+    template <typename T>
+    void apply(T* block, size_t num_rows, double* coefficients) const;
+
+    explicit ConstantQKernel(const Config& config);
+
+   private:
+    size_t                            transform_length_;
+    std::vector<double>               frequencies_;
+    std::vector<size_t>               offsets_;
+    std::vector<size_t>               bins_;
+    std::vector<std::complex<double>> weights_;
+};
+
+#endif /* CONSTANT_Q_H */
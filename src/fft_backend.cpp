@@ -0,0 +1,33 @@
+#include "fft_backend.h"
+
+const FFTBackend* FFTBackend::get(FFTBackendType type) {
+    switch (type) {
+        case FFT_BACKEND_DEFAULT:
+#ifdef WITH_FFTW
+            return fftw();
+#else
+            return builtin();
+#endif
+
+        case FFT_BACKEND_FFTW:
+#ifdef WITH_FFTW
+            return fftw();
+#else
+            return NULL;
+#endif
+
+        case FFT_BACKEND_BUILTIN:
+            return builtin();
+
+        default:
+            return NULL;
+    }
+}
+
+size_t FFTBackend::scratch_size(const PlanConfig&) const {
+    return 0;
+}
+
+void FFTBackend::load_wisdom(const std::string&, int) const {}
+
+void FFTBackend::save_wisdom(const std::string&, int) const {}
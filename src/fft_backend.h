@@ -0,0 +1,68 @@
+#ifndef FFT_BACKEND_H
+#define FFT_BACKEND_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "spectrogram.h"
+
+// Real transforms in FFTW's half-complex layout: from real samples (forward), or back without normalization (inverse)
+enum FFTKind { FFT_FORWARD, FFT_INVERSE };
+
+// A planned batch of in-place transforms of consecutive frames
+template <typename T>
+class FFTPlan {
+   public:
+    virtual ~FFTPlan() {}
+
+    // Transform the frames of a block allocated by the plan's backend, or of any block if planned unaligned. A plan may
+    // be executed on different blocks concurrently.
+    virtual void execute(T* block) const = 0;
+
+    // Values of scratch space an execution uses, for callers which must not allocate
+    virtual size_t scratch_size() const { return 0; }
+
+    // Execute with scratch_size() values of scratch supplied by the caller, so the plan allocates nothing
+    virtual void execute_with_scratch(T* block, T*) const { execute(block); }
+};
+
+// An FFT implementation: plans, and the buffers they execute on
+class FFTBackend {
+   public:
+    struct PlanConfig {
+        size_t       length;
+        size_t       num_frames;
+        FFTKind      kind;
+        PlannerRigor rigor;
+        bool         unaligned;
+    };
+
+    virtual ~FFTBackend() {}
+
+    // The backend of a type, or NULL if it is unknown or was not built. FFT_BACKEND_DEFAULT is FFTW when built.
+    static const FFTBackend* get(FFTBackendType type);
+
+    virtual FFTBackendType type() const = 0;
+
+    // Plan frames of config.length values each, length apart, on a buffer which planning may overwrite
+    virtual std::unique_ptr<FFTPlan<float>>  plan(const PlanConfig& config, float* buffer) const  = 0;
+    virtual std::unique_ptr<FFTPlan<double>> plan(const PlanConfig& config, double* buffer) const = 0;
+
+    // Values of scratch space the plan of a config will use, so callers can allocate it before planning
+    virtual size_t scratch_size(const PlanConfig& config) const;
+
+    // Buffers with the alignment plans expect. NULL is released as a no-op.
+    virtual void* allocate(size_t bytes) const = 0;
+    virtual void  release(void* buffer) const  = 0;
+
+    // Planning knowledge kept alongside a tuning database, for backends which accumulate it
+    virtual void load_wisdom(const std::string& tuning_file, int data_size) const;
+    virtual void save_wisdom(const std::string& tuning_file, int data_size) const;
+
+   protected:
+    static const FFTBackend* builtin();
+    static const FFTBackend* fftw();
+};
+
+#endif /* FFT_BACKEND_H */
@@ -0,0 +1,108 @@
+#include <fftw3.h>
+#include <mutex>
+
+#include "fft_backend.h"
+
+// FFTW's planner is not thread-safe, so plan creation and destruction are serialized across all transforms
+static std::mutex planner_mutex;
+
+// FFTW planner flags for a rigor. Plans must not overwrite the input, which is also the output.
+static unsigned int planner_flags(const FFTBackend::PlanConfig& config) {
+    unsigned int flags = FFTW_PRESERVE_INPUT | (config.unaligned ? FFTW_UNALIGNED : 0);
+
+    switch (config.rigor) {
+        case PLANNER_ESTIMATE:
+            return flags | FFTW_ESTIMATE;
+
+        case PLANNER_PATIENT:
+            return flags | FFTW_PATIENT;
+
+        default:
+            return flags | FFTW_MEASURE;
+    }
+}
+
+class FFTWPlanFloat : public FFTPlan<float> {
+   public:
+    explicit FFTWPlanFloat(fftwf_plan plan) : plan_(plan) {}
+    ~FFTWPlanFloat() override {
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        fftwf_destroy_plan(plan_);
+    }
+
+    void execute(float* block) const override { fftwf_execute_r2r(plan_, block, block); }
+
+   private:
+    fftwf_plan plan_;
+};
+
+class FFTWPlanDouble : public FFTPlan<double> {
+   public:
+    explicit FFTWPlanDouble(fftw_plan plan) : plan_(plan) {}
+    ~FFTWPlanDouble() override {
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        fftw_destroy_plan(plan_);
+    }
+
+    void execute(double* block) const override { fftw_execute_r2r(plan_, block, block); }
+
+   private:
+    fftw_plan plan_;
+};
+
+// Segments are transformed in chunks using FFTW's 64-bit guru interface, so neither the number of segments nor the
+// buffer size is limited to 2^31
+class FFTWBackend : public FFTBackend {
+   public:
+    FFTBackendType type() const override { return FFT_BACKEND_FFTW; }
+
+    std::unique_ptr<FFTPlan<float>> plan(const PlanConfig& config, float* buffer) const override {
+        const fftw_r2r_kind kind   = (config.kind == FFT_FORWARD) ? FFTW_R2HC : FFTW_HC2R;
+        const fftwf_iodim64 dims   = {(ptrdiff_t)config.length, 1, 1};
+        const fftwf_iodim64 frames = {(ptrdiff_t)config.num_frames, (ptrdiff_t)config.length,
+                                      (ptrdiff_t)config.length};
+
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        return std::unique_ptr<FFTPlan<float>>(new FFTWPlanFloat(
+            fftwf_plan_guru64_r2r(1, &dims, 1, &frames, buffer, buffer, &kind, planner_flags(config))));
+    }
+
+    std::unique_ptr<FFTPlan<double>> plan(const PlanConfig& config, double* buffer) const override {
+        const fftw_r2r_kind kind   = (config.kind == FFT_FORWARD) ? FFTW_R2HC : FFTW_HC2R;
+        const fftw_iodim64  dims   = {(ptrdiff_t)config.length, 1, 1};
+        const fftw_iodim64  frames = {(ptrdiff_t)config.num_frames, (ptrdiff_t)config.length,
+                                     (ptrdiff_t)config.length};
+
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        return std::unique_ptr<FFTPlan<double>>(new FFTWPlanDouble(
+            fftw_plan_guru64_r2r(1, &dims, 1, &frames, buffer, buffer, &kind, planner_flags(config))));
+    }
+
+    // FFTW's allocator guarantees the alignment of SIMD plans in either precision
+    void* allocate(size_t bytes) const override { return fftw_malloc(bytes); }
+    void  release(void* buffer) const override { fftw_free(buffer); }
+
+    // Wisdom is kept next to the tuning database, so tuned plans are recreated without measuring again
+    void load_wisdom(const std::string& tuning_file, int data_size) const override {
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        if (data_size == sizeof(float)) {
+            fftwf_import_wisdom_from_filename((tuning_file + ".fftwf-wisdom").c_str());
+        } else if (data_size == sizeof(double)) {
+            fftw_import_wisdom_from_filename((tuning_file + ".fftw-wisdom").c_str());
+        }
+    }
+
+    void save_wisdom(const std::string& tuning_file, int data_size) const override {
+        std::lock_guard<std::mutex> lock(planner_mutex);
+        if (data_size == sizeof(float)) {
+            fftwf_export_wisdom_to_filename((tuning_file + ".fftwf-wisdom").c_str());
+        } else if (data_size == sizeof(double)) {
+            fftw_export_wisdom_to_filename((tuning_file + ".fftw-wisdom").c_str());
+        }
+    }
+};
+
+const FFTBackend* FFTBackend::fftw() {
+    static const FFTWBackend backend;
+    return &backend;
+}
@@ -0,0 +1,133 @@
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Filter half-length in multiples of the larger rate factor, and the Kaiser window shape: about 80 dB of stopband
+// attenuation, with the transition band centred on the lower Nyquist rate
+static const size_t kHalfLengthPerFactor = 16;
+static const double kKaiserBeta          = 8.0;
+
+// Output samples computed from each contiguous block of input
+static const size_t kBlockOutputs = 1024;
+
+// Zeroth-order modified Bessel function of the first kind, by its power series
+static double bessel_i0(double x) {
+    double sum  = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > 1e-17 * sum; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static size_t gcd(size_t a, size_t b) {
+    while (b != 0) {
+        const size_t r = a % b;
+        a              = b;
+        b              = r;
+    }
+    return a;
+}
+
+Resampler::Resampler(size_t interpolation, size_t decimation) {
+    const size_t common = gcd(interpolation, decimation);
+    interpolation_      = interpolation / common;
+    decimation_         = decimation / common;
+
+    // Prototype low-pass filter at the interpolated rate
+    const size_t        factor = std::max(interpolation_, decimation_);
+    const double        cutoff = 1.0 / factor;
+    std::vector<double> filter(2 * kHalfLengthPerFactor * factor + 1);
+    double              sum = 0.0;
+
+    half_length_ = kHalfLengthPerFactor * factor;
+    for (size_t k = 0; k < filter.size(); k++) {
+        const double offset = (double)k - (double)half_length_;
+        const double ratio  = offset / half_length_;
+        const double sinc   = (offset == 0.0) ? 1.0 : sin(M_PI * cutoff * offset) / (M_PI * cutoff * offset);
+        filter[k]           = sinc * bessel_i0(kKaiserBeta * sqrt(1.0 - ratio * ratio));
+        sum += filter[k];
+    }
+
+    // Split into phases, each padded to a multiple of four taps. Zero samples inserted by interpolation are never
+    // multiplied, and each phase has unit gain at DC.
+    phase_taps_ = (filter.size() + interpolation_ - 1) / interpolation_;
+    phase_taps_ = (phase_taps_ + 3) / 4 * 4;
+    phases_.assign(interpolation_ * phase_taps_, 0.0);
+    for (size_t phase = 0; phase < interpolation_; phase++) {
+        for (size_t tap = 0; tap < phase_taps_ && phase + tap * interpolation_ < filter.size(); tap++) {
+            phases_[phase * phase_taps_ + phase_taps_ - 1 - tap] =
+                interpolation_ * filter[phase + tap * interpolation_] / sum;
+        }
+    }
+}
+
+size_t Resampler::output_length(size_t num_samples) const {
+    return (num_samples * interpolation_ + decimation_ - 1) / decimation_;
+}
+
+void Resampler::reset(State& state) const {
+    state.input = NULL;
+    state.start = 0;
+    state.size  = 0;
+    state.buffer.resize(kBlockOutputs * decimation_ / interpolation_ + phase_taps_ + 2);
+}
+
+template <typename T>
+void Resampler::process(const T* input, size_t num_samples, size_t stride, T* output) const {
+    State state;
+    reset(state);
+    process<T>(input, num_samples, stride, 0, output_length(num_samples), output, state);
+}
+template void Resampler::process<float>(const float*, size_t, size_t, float*) const;
+template void Resampler::process<double>(const double*, size_t, size_t, double*) const;
+
+// Outputs are computed a block at a time from a contiguous copy of the input they need. The input still needed by
+// the next block, the filter state, is carried over rather than gathered again, including across calls for
+// consecutive ranges, and each output is a dot product of one phase with consecutive samples, summed in four lanes.
+template <typename T>
+void Resampler::process(const T* input, size_t num_samples, size_t stride, size_t first_output, size_t last_output,
+                        T* output, State& state) const {
+    double* buffer = state.buffer.data();
+    if (state.input != input) {
+        state.input = input;
+        state.size  = 0;
+    }
+
+    for (size_t first = first_output; first < last_output; first += kBlockOutputs) {
+        const size_t    last        = std::min(first + kBlockOutputs, last_output);
+        const ptrdiff_t block_start = first_input(first);
+        const ptrdiff_t block_end   = first_input(last - 1) + (ptrdiff_t)phase_taps_;
+
+        // Keep the overlap with the previous block, then gather the rest, zero outside the signal
+        const ptrdiff_t buffer_end = state.start + (ptrdiff_t)state.size;
+        const bool      overlaps   = state.start <= block_start && buffer_end > block_start;
+        const size_t    keep       = overlaps ? (size_t)(std::min(buffer_end, block_end) - block_start) : 0;
+        memmove(buffer, buffer + (block_start - state.start), sizeof(double) * keep);
+        for (ptrdiff_t index = block_start + (ptrdiff_t)keep; index < block_end; index++) {
+            const bool inside           = index >= 0 && (size_t)index < num_samples;
+            buffer[index - block_start] = inside ? (double)input[stride * index] : 0.0;
+        }
+        state.start = block_start;
+        state.size  = (size_t)(block_end - block_start);
+
+        for (size_t out = first; out < last; out++) {
+            const size_t  phase    = (out * decimation_ + half_length_) % interpolation_;
+            const double* taps     = phases_.data() + phase * phase_taps_;
+            const double* samples  = buffer + (first_input(out) - block_start);
+            double        lanes[4] = {0.0, 0.0, 0.0, 0.0};
+
+            for (size_t tap = 0; tap < phase_taps_; tap += 4) {
+                lanes[0] += taps[tap] * samples[tap];
+                lanes[1] += taps[tap + 1] * samples[tap + 1];
+                lanes[2] += taps[tap + 2] * samples[tap + 2];
+                lanes[3] += taps[tap + 3] * samples[tap + 3];
+            }
+            output[out - first_output] = (T)((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]));
+        }
+    }
+}
+template void Resampler::process<float>(const float*, size_t, size_t, size_t, size_t, float*, State&) const;
+template void Resampler::process<double>(const double*, size_t, size_t, size_t, size_t, double*, State&) const;
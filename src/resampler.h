@@ -0,0 +1,61 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <vector>
+
+// Polyphase FIR resampler changing the rate by interpolation / decimation
+//
+// The anti-aliasing filter is a Kaiser-windowed sinc cut off at the lower of the two Nyquist rates. It is centred on
+// each output sample, so output sample n lies at input time n * decimation / interpolation, and samples beyond either
+// end of the signal are taken as zero.
+class Resampler {
+   public:
+    // Input samples gathered for the last range of outputs, kept so that the next range reuses the overlap
+    struct State {
+        State() : input(NULL), start(0), size(0) {}
+
+        const void*         input;
+        std::vector<double> buffer;
+        ptrdiff_t           start;
+        size_t              size;
+    };
+
+    Resampler(size_t interpolation, size_t decimation);
+
+    size_t interpolation() const { return interpolation_; }
+    size_t decimation() const { return decimation_; }
+    size_t num_taps() const { return phases_.size(); }
+
+    // Number of output samples lying within a signal of num_samples samples
+    size_t output_length(size_t num_samples) const;
+
+    // Resample num_samples samples, stride apart, into output_length(num_samples) contiguous samples
+    template <typename T>
+    void process(const T* input, size_t num_samples, size_t stride, T* output) const;
+
+    // Resample outputs first...last - 1 of the same signal into contiguous samples. Each output is computed exactly as
+    // by process, whatever the ranges.
+    template <typename T>
+    void process(const T* input, size_t num_samples, size_t stride, size_t first, size_t last, T* output,
+                 State& state) const;
+
+    // Allocate the state's buffer and forget any samples it holds, which must be done whenever the input changes
+    void reset(State& state) const;
+
+   private:
+    // First input sample contributing to an output sample, which may lie before the signal
+    ptrdiff_t first_input(size_t output_index) const {
+        return (ptrdiff_t)((output_index * decimation_ + half_length_) / interpolation_) - (ptrdiff_t)(phase_taps_ - 1);
+    }
+
+    size_t interpolation_;
+    size_t decimation_;
+    size_t half_length_;
+    size_t phase_taps_;
+
+    // Filter taps of each phase, reversed so that they are applied to consecutive input samples in order
+    std::vector<double> phases_;
+};
+
+#endif /* RESAMPLER_H */
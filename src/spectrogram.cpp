@@ -1,5 +1,6 @@
 #include "spectrogram.h"
 #include <stdlib.h>
+#include <string.h>
 #include "stft.h"
 
 #if defined _WIN32 || defined __CYGWIN__
@@ -27,11 +28,26 @@
 #endif
 #endif
 
+// Configuration defaults
+DLL_PUBLIC void spectrogram_init_config(SpectrogramConfig* config) {
+    memset(config, 0, sizeof(SpectrogramConfig));
+    config->padding_mode   = TRUNCATE;
+    config->window_type    = RECTANGULAR;
+    config->execution_mode = EXECUTION_AUTO;
+    config->planner_rigor  = PLANNER_DEFAULT;
+    config->detrend        = DETREND_NONE;
+    config->fft_backend    = FFT_BACKEND_DEFAULT;
+}
+
 // Create
 DLL_PUBLIC SpectrogramTransform* spectrogram_create(SpectrogramInput* props, SpectrogramConfig* config) {
     return reinterpret_cast<SpectrogramTransform*>(new STFT(*props, *config));
 }
 
+DLL_PUBLIC size_t spectrogram_estimate_memory(SpectrogramInput* props, SpectrogramConfig* config) {
+    return STFT::estimate_memory(*props, *config);
+}
+
 // Execute
 DLL_PUBLIC void spectrogram_execute(SpectrogramTransform* transform, void* input) {
     STFT* mystft = reinterpret_cast<STFT*>(transform);
@@ -39,6 +55,16 @@ DLL_PUBLIC void spectrogram_execute(SpectrogramTransform* transform, void* input
 }
 
 // Get output parameters
+DLL_PUBLIC ExecutionMode spectrogram_get_execution_mode(SpectrogramTransform* transform) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    return mystft->execution_mode();
+}
+
+DLL_PUBLIC FFTBackendType spectrogram_get_fft_backend(SpectrogramTransform* transform) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    return mystft->fft_backend();
+}
+
 DLL_PUBLIC size_t spectrogram_get_timelen(SpectrogramTransform* transform) {
     STFT* mystft = reinterpret_cast<STFT*>(transform);
     return mystft->num_windows();
@@ -94,6 +120,122 @@ DLL_PUBLIC void spectrogram_get_phase(SpectrogramTransform* transform, void* pha
     }
 }
 
+DLL_PUBLIC void spectrogram_get_power_phase(SpectrogramTransform* transform, void* power, void* phase) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_power_phase<float>(power, phase);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_power_phase<double>(power, phase);
+    }
+}
+
+DLL_PUBLIC const void* spectrogram_get_power_view(SpectrogramTransform* transform) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        return mystft->power_view<float>();
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        return mystft->power_view<double>();
+    }
+    return NULL;
+}
+
+DLL_PUBLIC const void* spectrogram_get_phase_view(SpectrogramTransform* transform) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        return mystft->phase_view<float>();
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        return mystft->phase_view<double>();
+    }
+    return NULL;
+}
+
+DLL_PUBLIC void spectrogram_get_power_phase_strided(SpectrogramTransform* transform, const SpectrogramOutput* power,
+                                                    const SpectrogramOutput* phase) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_power_phase_strided<float>(power, phase);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_power_phase_strided<double>(power, phase);
+    }
+}
+
+DLL_PUBLIC void spectrogram_get_spectra_view(SpectrogramTransform* transform, SpectrogramSpectraView* view) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    view->data       = mystft->fourier_spectra();
+    view->layout     = mystft->constant_q() ? SPECTRA_CONSTANT_Q : SPECTRA_HALFCOMPLEX;
+    view->num_rows   = mystft->tiled() ? 0 : mystft->num_windows();
+    view->row_length = mystft->constant_q() ? 2 * mystft->num_frequencies() : mystft->transform_length();
+    view->row_pitch  = mystft->transform_length();
+    view->data_size  = mystft->data_size();
+}
+
+DLL_PUBLIC void spectrogram_get_frame_mask(SpectrogramTransform* transform, unsigned char* mask) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->get_frame_mask(mask);
+}
+
+DLL_PUBLIC void spectrogram_get_features(SpectrogramTransform* transform, unsigned int features, void* out) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_features<float>(features, out);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_features<double>(features, out);
+    }
+}
+
+DLL_PUBLIC void spectrogram_get_peaks(SpectrogramTransform* transform, size_t K, size_t min_separation, void* freq,
+                                      void* power) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_peaks<float>(K, min_separation, freq, power);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_peaks<double>(K, min_separation, freq, power);
+    }
+}
+
+DLL_PUBLIC void spectrogram_get_cross_spectra(SpectrogramTransform* transform, const void* const* inputs,
+                                              size_t num_channels, const SpectrogramChannelPair* pairs,
+                                              size_t num_pairs, void* csd, void* coherence, void* cross_phase) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_cross_spectra<float>(inputs, num_channels, pairs, num_pairs, csd, coherence, cross_phase);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_cross_spectra<double>(inputs, num_channels, pairs, num_pairs, csd, coherence, cross_phase);
+    }
+}
+
+DLL_PUBLIC void spectrogram_get_image(SpectrogramTransform* transform, double db_min, double db_max, ImageFormat format,
+                                      void* out) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_image<float>(db_min, db_max, format, out);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_image<double>(db_min, db_max, format, out);
+    }
+}
+
+DLL_PUBLIC void spectrogram_set_colormap(SpectrogramTransform* transform, const unsigned char* colormap) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->set_colormap(colormap);
+}
+
 DLL_PUBLIC void spectrogram_get_power_periodogram(SpectrogramTransform* transform, void* power) {
     STFT* mystft = reinterpret_cast<STFT*>(transform);
 
@@ -105,6 +247,18 @@ DLL_PUBLIC void spectrogram_get_power_periodogram(SpectrogramTransform* transfor
     }
 }
 
+DLL_PUBLIC void spectrogram_get_percentile_periodogram(SpectrogramTransform* transform, double percentile,
+                                                       void* power) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_percentile_periodogram<float>(percentile, power);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_percentile_periodogram<double>(percentile, power);
+    }
+}
+
 DLL_PUBLIC void spectrogram_get_phase_periodogram(SpectrogramTransform* transform, void* phase) {
     STFT* mystft = reinterpret_cast<STFT*>(transform);
 
@@ -116,6 +270,162 @@ DLL_PUBLIC void spectrogram_get_phase_periodogram(SpectrogramTransform* transfor
     }
 }
 
+DLL_PUBLIC void spectrogram_get_cepstrum(SpectrogramTransform* transform, void* cepstrum) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_cepstrum<float>(cepstrum);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_cepstrum<double>(cepstrum);
+    }
+}
+
+DLL_PUBLIC void spectrogram_get_autocorrelation(SpectrogramTransform* transform, void* autocorrelation) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_autocorrelation<float>(autocorrelation);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_autocorrelation<double>(autocorrelation);
+    }
+}
+
+// Range queries
+DLL_PUBLIC void spectrogram_bind(SpectrogramTransform* transform, const void* input) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->bind(input);
+}
+
+DLL_PUBLIC size_t spectrogram_get_range_timelen(SpectrogramTransform* transform, double start_time, double end_time,
+                                                size_t* first_window) {
+    STFT*  mystft = reinterpret_cast<STFT*>(transform);
+    size_t first  = 0;
+    size_t count  = mystft->range_windows(start_time, end_time, &first);
+
+    if (first_window) {
+        *first_window = first;
+    }
+    return count;
+}
+
+DLL_PUBLIC void spectrogram_get_power_range(SpectrogramTransform* transform, double start_time, double end_time,
+                                            void* power) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_power_range<float>(start_time, end_time, power);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_power_range<double>(start_time, end_time, power);
+    }
+}
+
+// Batches
+DLL_PUBLIC size_t spectrogram_execute_batch(SpectrogramTransform* transform, const SpectrogramClip* clips,
+                                            size_t num_clips, size_t* offsets) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    return mystft->compute_batch(clips, num_clips, offsets);
+}
+
+DLL_PUBLIC void spectrogram_get_batch_power_phase(SpectrogramTransform* transform, void* power, void* phase) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_batch_power_phase<float>(power, phase);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_batch_power_phase<double>(power, phase);
+    }
+}
+
+// Workspaces for concurrent execution
+DLL_PUBLIC SpectrogramWorkspace* spectrogram_workspace_create(SpectrogramTransform* transform) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    return reinterpret_cast<SpectrogramWorkspace*>(mystft->create_workspace());
+}
+
+DLL_PUBLIC void spectrogram_execute_workspace(SpectrogramTransform* transform, SpectrogramWorkspace* workspace,
+                                              const void* input) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->compute(input, *reinterpret_cast<STFTWorkspace*>(workspace));
+}
+
+DLL_PUBLIC void spectrogram_workspace_get_power_phase(SpectrogramTransform* transform, SpectrogramWorkspace* workspace,
+                                                      void* power, void* phase) {
+    STFT*          mystft      = reinterpret_cast<STFT*>(transform);
+    STFTWorkspace* myworkspace = reinterpret_cast<STFTWorkspace*>(workspace);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_power_phase<float>(*myworkspace, power, phase);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_power_phase<double>(*myworkspace, power, phase);
+    }
+}
+
+DLL_PUBLIC void spectrogram_workspace_get_features(SpectrogramTransform* transform, SpectrogramWorkspace* workspace,
+                                                   unsigned int features, void* out) {
+    STFT*          mystft      = reinterpret_cast<STFT*>(transform);
+    STFTWorkspace* myworkspace = reinterpret_cast<STFTWorkspace*>(workspace);
+
+    if (mystft->data_size() == sizeof(float)) {
+        mystft->get_features<float>(*myworkspace, features, out);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        mystft->get_features<double>(*myworkspace, features, out);
+    }
+}
+
+DLL_PUBLIC void spectrogram_workspace_destroy(SpectrogramTransform* transform, SpectrogramWorkspace* workspace) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->destroy_workspace(reinterpret_cast<STFTWorkspace*>(workspace));
+}
+
+// Real-time streams
+DLL_PUBLIC SpectrogramRealtime* spectrogram_realtime_create(SpectrogramTransform* transform, size_t queue_length) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    return reinterpret_cast<SpectrogramRealtime*>(mystft->create_realtime(queue_length));
+}
+
+DLL_PUBLIC size_t spectrogram_realtime_push(SpectrogramTransform* transform, SpectrogramRealtime* realtime,
+                                            const void* samples, size_t num_samples) {
+    STFT*         mystft     = reinterpret_cast<STFT*>(transform);
+    STFTRealtime* myrealtime = reinterpret_cast<STFTRealtime*>(realtime);
+
+    if (mystft->data_size() == sizeof(float)) {
+        return mystft->push_realtime<float>(*myrealtime, (const float*)samples, num_samples);
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        return mystft->push_realtime<double>(*myrealtime, (const double*)samples, num_samples);
+    }
+    return 0;
+}
+
+DLL_PUBLIC int spectrogram_realtime_pop(SpectrogramTransform* transform, SpectrogramRealtime* realtime, void* power,
+                                        size_t* frame) {
+    STFT*         mystft     = reinterpret_cast<STFT*>(transform);
+    STFTRealtime* myrealtime = reinterpret_cast<STFTRealtime*>(realtime);
+
+    if (mystft->data_size() == sizeof(float)) {
+        return mystft->pop_realtime<float>(*myrealtime, (float*)power, frame) ? 1 : 0;
+
+    } else if (mystft->data_size() == sizeof(double)) {
+        return mystft->pop_realtime<double>(*myrealtime, (double*)power, frame) ? 1 : 0;
+    }
+    return 0;
+}
+
+DLL_PUBLIC size_t spectrogram_realtime_dropped(SpectrogramTransform*, SpectrogramRealtime* realtime) {
+    return reinterpret_cast<STFTRealtime*>(realtime)->dropped.load(std::memory_order_relaxed);
+}
+
+DLL_PUBLIC void spectrogram_realtime_destroy(SpectrogramTransform* transform, SpectrogramRealtime* realtime) {
+    STFT* mystft = reinterpret_cast<STFT*>(transform);
+    mystft->destroy_realtime(reinterpret_cast<STFTRealtime*>(realtime));
+}
+
 // Destroy
 DLL_PUBLIC void spectrogram_destroy(SpectrogramTransform* transform) {
     STFT* mystft = reinterpret_cast<STFT*>(transform);
@@ -1,10 +1,182 @@
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <thread>
 
 #include "stft.h"
 
-STFT::STFT(const SpectrogramInput& new_props, const SpectrogramConfig& new_config) {
+// Upper bound on the size of the block of spectra transformed by one FFT plan execution
+static const size_t kChunkBytes = 1 << 20;
+
+// Chunks are a multiple of this many segments so every chunk keeps the alignment the plans were created with
+static const size_t kChunkAlignFrames = 16;
+
+// Run function(i, worker) for i = 0...count-1 on up to num_threads threads, including the calling thread. Each call
+// gets the index of the thread running it, below num_threads, so threads can reuse their own scratch.
+template <typename Function>
+static void parallel_for_workers(size_t count, int num_threads, const Function& function) {
+    const size_t num_workers = std::min((size_t)num_threads, count);
+
+    std::vector<std::thread> workers;
+    for (size_t worker = 1; worker < num_workers; worker++) {
+        workers.emplace_back([&, worker]() {
+            for (size_t i = worker; i < count; i += num_workers) {
+                function(i, worker);
+            }
+        });
+    }
+
+    for (size_t i = 0; i < count; i += std::max(num_workers, (size_t)1)) {
+        function(i, (size_t)0);
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Run function(i) for i = 0...count-1 on up to num_threads threads, including the calling thread
+template <typename Function>
+static void parallel_for(size_t count, int num_threads, const Function& function) {
+    parallel_for_workers(count, num_threads, [&](size_t i, size_t) { function(i); });
+}
+
+// Fraction of power below the spectral rolloff unless configured
+static const double kDefaultRolloffFraction = 0.85;
+
+// Number of segments handed to a thread at a time when picking peaks
+static const size_t kPeakRows = 64;
+
+// Approximate log2 from the float exponent and a quintic fit of the mantissa on [1, 2), accurate to 2e-5
+static inline float fast_log2(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const float exponent = (float)((int)((bits >> 23) & 255) - 127);
+    bits                 = (bits & 0x007FFFFF) | 0x3F800000;
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    return exponent - 2.79415124f +
+           m * (5.06974773f + m * (-3.52020691f + m * (1.61016938f + m * (-0.40947283f + m * 0.04392826f))));
+}
+
+// Number of segments summed sequentially into each leaf of the power periodogram reduction tree
+static const size_t kSumRows = 256;
+
+// Number of frequency bins transposed together when gathering bin columns for percentile periodograms
+static const size_t kTransposeBins = 16;
+
+// Number of tiles of power kept for range queries unless configured
+static const size_t kDefaultCacheTiles = 32;
+
+// Number of segments extracted at a time when writing through strided output descriptors
+static const size_t kOutputTileRows = 16;
+
+// Number of input samples the sliding DFT may advance recursively before its state is re-anchored with FFTs
+static const size_t kSlidingDFTAnchorSamples = 4096;
+
+// Coefficients of the generalized cosine-sum windows: w[i] = sum_r (-1)^r alpha[r] cos(2 pi r i / (N - 1))
+// Returns the number of terms, or 0 if the window is not a cosine-sum window
+static size_t cosine_sum_terms(WindowType window_type, double* alpha) {
+    switch (window_type) {
+        case RECTANGULAR:
+            alpha[0] = 1.0;
+            return 1;
+
+        case HANN:
+            alpha[0] = 0.5;
+            alpha[1] = 0.5;
+            return 2;
+
+        case HAMMING:
+            alpha[0] = 25.0 / 46.0;
+            alpha[1] = 21.0 / 46.0;
+            return 2;
+
+        case BLACKMAN:
+            alpha[0] = 7938.0 / 18608.0;
+            alpha[1] = 9240.0 / 18608.0;
+            alpha[2] = 1430.0 / 18608.0;
+            return 3;
+
+        case NUTTALL:
+            alpha[0] = 0.355768;
+            alpha[1] = 0.487396;
+            alpha[2] = 0.144232;
+            alpha[3] = 0.012604;
+            return 4;
+
+        case BLACKMAN_NUTTALL:
+            alpha[0] = 0.3635819;
+            alpha[1] = 0.4891775;
+            alpha[2] = 0.1365995;
+            alpha[3] = 0.0106411;
+            return 4;
+
+        case BLACKMAN_HARRIS:
+            alpha[0] = 0.35875;
+            alpha[1] = 0.48829;
+            alpha[2] = 0.14128;
+            alpha[3] = 0.01168;
+            return 4;
+
+        default:
+            return 0;
+    }
+}
+
+STFT::STFT() {
+    // Empty state
+    fft_backend_           = NULL;
+    workspace_             = NULL;
+    bound_signal_          = NULL;
+    tile_spectra_          = NULL;
+    batch_spectra_         = NULL;
+    batch_frames_          = 0;
+    batch_capacity_        = 0;
+    batch_rows_            = 0;
+    execution_count_       = 0;
+    power_cache_execution_ = 0;
+    phase_cache_execution_ = 0;
+}
+
+STFT::STFT(const SpectrogramInput& new_props, const SpectrogramConfig& new_config) : STFT() {
+    configure(new_props, new_config);
+
+    // Time the candidate strategies once and record the fastest, then configure again to pick it up
+    if (new_config.autotune && !tuning_file_.empty() && !tuned_ && num_windows_ > 0) {
+        if (store_tuning(tuning_file_, tuning_key(), measure_tuning(new_props, new_config))) {
+            configure(new_props, new_config);
+        }
+    }
+
+    if (constant_q()) {
+        const ConstantQKernel::Config kernel_config = {sample_rate_,     transform_length_, window_length_,
+                                                       bins_per_octave_, min_frequency_,    num_frequencies_};
+        constant_q_kernel_ = ConstantQKernel::get(kernel_config);
+    }
+
+    // Initialize
+    init_window_coefs();
+    init_sliding_dft();
+
+    // Allocate spectra buffer and create FFT plan
+    init_fft();
+
+    init_time();
+    init_frequency();
+}
+
+// Copy and validate the parameters, and derive the sizes of everything the transform allocates
+void STFT::configure(const SpectrogramInput& new_props, const SpectrogramConfig& new_config) {
     // Copy inputs to internal
     sample_rate_      = new_props.sample_rate;
     num_samples_      = new_props.num_samples;
@@ -15,33 +187,101 @@ STFT::STFT(const SpectrogramInput& new_props, const SpectrogramConfig& new_confi
     window_length_    = new_config.window_length;
     window_overlap_   = new_config.window_overlap;
     transform_length_ = new_config.transform_length;
+    execution_mode_   = new_config.execution_mode;
+    cache_outputs_    = new_config.cache_outputs != 0;
+    max_tiles_        = (new_config.cache_tiles > 0) ? new_config.cache_tiles : kDefaultCacheTiles;
+    max_memory_bytes_ = new_config.max_memory_bytes;
+    gate_threshold_   = new_config.gate_threshold;
+    gate_floor_       = new_config.gate_floor;
+    rolloff_fraction_ = (new_config.rolloff_fraction > 0.0) ? new_config.rolloff_fraction : kDefaultRolloffFraction;
+    detrend_          = new_config.detrend;
+    pre_emphasis_     = new_config.pre_emphasis;
+    bins_per_octave_  = new_config.bins_per_octave;
+    min_frequency_    = new_config.min_frequency;
+    max_frequency_    = new_config.max_frequency;
+    planner_rigor_    = new_config.planner_rigor;
+    chunk_override_   = new_config.chunk_frames;
+    num_threads_      = new_config.num_threads;
+    tuning_file_      = new_config.tuning_file ? new_config.tuning_file : "";
+    fft_backend_      = FFTBackend::get(new_config.fft_backend);
 
     // Validate inputs
     validate();
 
+    // Resample in front of segmentation: the signal is then contiguous at the resampled rate, so window lengths, the
+    // hop and the time and frequency axes are all in resampled samples
+    input_samples_ = num_samples_;
+    input_stride_  = stride_;
+    resampler_.reset();
+
+    const size_t decimation    = std::max(new_config.decimation, (size_t)1);
+    const size_t interpolation = std::max(new_config.interpolation, (size_t)1);
+    if (decimation != interpolation) {
+        resampler_.reset(new Resampler(interpolation, decimation));
+        num_samples_ = resampler_->output_length(input_samples_);
+        sample_rate_ = sample_rate_ * resampler_->interpolation() / resampler_->decimation();
+        stride_      = 1;
+    }
+
+    if (constant_q()) {
+        configure_constant_q();
+    }
+
     // Initialize derived parameters
     calc_num_windows();
     calc_num_frequencies();
+    apply_tuning();
+    select_execution_mode();
+    calc_chunking();
+}
 
-    // Allocate spectra buffer and create FFT plan
-    init_fft();
+size_t STFT::estimate_memory(const SpectrogramInput& input, const SpectrogramConfig& config) {
+    STFT sizing;
+    sizing.configure(input, config);
+    return sizing.memory_bytes();
+}
 
-    // Initialize
-    init_window_coefs();
-    init_time();
-    init_frequency();
+// Bytes allocated by the transform, excluding the FFT plans and range query tiles
+size_t STFT::memory_bytes() const {
+    const size_t spectra_rows = tiled_ ? chunk_frames_ : num_windows_;
+    size_t       bytes        = spectra_rows * transform_length_ * data_size_;
+
+    bytes += sizeof(double) * (window_length_ + num_windows_ + 2 * num_frequencies_);
+
+    if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+        double       alpha[4];
+        const size_t num_recursions = 2 * cosine_sum_terms(window_type_, alpha) - 1;
+
+        bytes += transform_length_ * (data_size_ + sizeof(double));
+        bytes += 3 * num_frequencies_ * num_recursions * sizeof(std::complex<double>);
+    }
+
+    if (cache_outputs_) {
+        bytes += 2 * num_windows_ * num_frequencies_ * data_size_;
+    }
+
+    if (gated()) {
+        bytes += num_windows_;
+    }
+
+    // The sliding DFT reads the whole resampled signal, FFTs resample the samples of a chunk at a time
+    if (resampler_) {
+        const size_t chunk_samples = chunk_frames_ * (window_length_ - window_overlap_) + window_length_ + 1;
+        bytes += (execution_mode_ == EXECUTION_SLIDING_DFT ? num_samples_ : chunk_samples) * data_size_;
+        bytes += resampler_->num_taps() * sizeof(double);
+    }
+
+    return bytes;
 }
 
 STFT::~STFT() {
-    if (isFloat()) {
-        fftwf_free(fourier_spectra_);
-        fftwf_destroy_plan(fftwf_plan_);
-        fftwf_cleanup();
-
-    } else if (isDouble()) {
-        fftw_free(fourier_spectra_);
-        fftw_destroy_plan(fftw_plan_);
-        fftw_cleanup();
+    destroy_workspace(workspace_);
+    if (fft_backend_) {
+        fft_backend_->release(tile_spectra_);
+        fft_backend_->release(batch_spectra_);
+        for (void* block : inverse_blocks_) {
+            fft_backend_->release(block);
+        }
     }
 }
 
@@ -74,78 +314,452 @@ void STFT::validate() {
 
     if (stride_ < 1) {
         fprintf(stderr, "WARNING: Stride cannot be less than 1. Setting to 1.");
+        stride_ = 1;
+    }
+
+    if (execution_mode_ != EXECUTION_AUTO && execution_mode_ != EXECUTION_FFT &&
+        execution_mode_ != EXECUTION_SLIDING_DFT) {
+        fprintf(stderr, "WARNING: Unknown execution mode. Setting to automatic.");
+        execution_mode_ = EXECUTION_AUTO;
+    }
+
+    if (planner_rigor_ < PLANNER_DEFAULT || planner_rigor_ > PLANNER_PATIENT) {
+        fprintf(stderr, "WARNING: Unknown planner rigor. Setting to default.");
+        planner_rigor_ = PLANNER_DEFAULT;
+    }
+
+    if (gate_threshold_ < 0.0) {
+        fprintf(stderr, "WARNING: Gate threshold cannot be negative. Disabling the gate.");
+        gate_threshold_ = 0.0;
+    }
+
+    if (rolloff_fraction_ > 1.0) {
+        fprintf(stderr, "WARNING: Rolloff fraction cannot be greater than 1. Setting to 1.");
+        rolloff_fraction_ = 1.0;
+    }
+
+    if (detrend_ != DETREND_NONE && detrend_ != DETREND_CONSTANT && detrend_ != DETREND_LINEAR) {
+        fprintf(stderr, "WARNING: Unknown detrend mode. Setting to none.");
+        detrend_ = DETREND_NONE;
+    }
+
+    if (num_threads_ < 0) {
+        fprintf(stderr, "WARNING: Number of threads cannot be negative. Setting to default.");
+        num_threads_ = 0;
+    }
+
+    if (!fft_backend_) {
+        fprintf(stderr, "WARNING: FFT backend is unknown or was not built. Setting to default.");
+        fft_backend_ = FFTBackend::get(FFT_BACKEND_DEFAULT);
     }
 }
 
+// Number of segments: (samples - length) / increment + 1, rounded down (TRUNCATE) or up (PAD)
+// Integer arithmetic keeps this exact for signals beyond 2^53 samples
 void STFT::calc_num_windows() {
-    const double samples     = (double)num_samples_;
-    const double length      = (double)window_length_;
-    const double increment   = (double)window_length_ - window_overlap_;
-    const double num_windows = (samples - length) / increment + 1.0;
+    num_windows_ = count_windows(num_samples_);
+}
+
+// Number of segments of a signal of the given length
+size_t STFT::count_windows(size_t num_samples) const {
+    const size_t increment = window_length_ - window_overlap_;
 
     switch (padding_mode_) {
         case TRUNCATE:
-            num_windows_ = (unsigned long)floor(num_windows);
-            break;
+            if (num_samples < window_length_) {
+                return 0;
+            }
+            return (num_samples - window_length_) / increment + 1;
 
         case PAD:
-            num_windows_ = (unsigned long)ceil(num_windows);
-            break;
+            if (num_samples < window_length_) {
+                return (window_length_ - num_samples < increment) ? 1 : 0;
+            }
+            return (num_samples - window_length_ + increment - 1) / increment + 1;
 
         default:
             throw "Unknown padding mode";
     }
 }
 
+// Size the chunks of segments transformed by one plan execution
+//
+// If holding the spectra of every segment would exceed the memory budget, the transform is tiled: only one chunk of
+// spectra, sized to fit the budget, is held and chunks are recomputed from the input as outputs are requested
+void STFT::calc_chunking() {
+    const size_t frame_bytes = transform_length_ * data_size_;
+    const size_t fit_frames  = kChunkBytes / frame_bytes / kChunkAlignFrames * kChunkAlignFrames;
+    const size_t pinned      = (chunk_override_ + kChunkAlignFrames - 1) / kChunkAlignFrames * kChunkAlignFrames;
+    chunk_frames_            = (pinned > 0) ? pinned : std::max(kChunkAlignFrames, fit_frames);
+    chunk_frames_            = std::min(chunk_frames_, num_windows_);
+    tiled_                   = false;
+
+    if (max_memory_bytes_ > 0 && num_windows_ > 1 && memory_bytes() > max_memory_bytes_) {
+        // The sliding DFT writes every segment, so tiled transforms use FFTs
+        execution_mode_ = EXECUTION_FFT;
+
+        // Start from a single-segment chunk and spend the rest of the budget on more segments, each with its spectrum
+        // and any resampled samples of its hop
+        const size_t frame_cost = frame_bytes + (resampler_ ? (window_length_ - window_overlap_) * data_size_ : 0);
+        tiled_                  = true;
+        chunk_frames_           = 1;
+        const size_t base_bytes = memory_bytes() - frame_cost;
+        if (max_memory_bytes_ > base_bytes) {
+            chunk_frames_ = std::min((max_memory_bytes_ - base_bytes) / frame_cost, num_windows_);
+            chunk_frames_ = std::max((size_t)1, chunk_frames_);
+        }
+        if (memory_bytes() > max_memory_bytes_) {
+            fprintf(stderr, "WARNING: Memory budget is too small for a single segment. Exceeding it.");
+        }
+    }
+
+    tail_frames_ = (chunk_frames_ > 0) ? num_windows_ % chunk_frames_ : 0;
+
+    // Batches are cut into many chunks, so theirs are rounded up to keep every chunk aligned
+    batch_frames_ = (chunk_frames_ + kChunkAlignFrames - 1) / kChunkAlignFrames * kChunkAlignFrames;
+}
+
+// Fill the strategy fields left at their defaults from the tuning database, then from the built-in defaults
+void STFT::apply_tuning() {
+    TuningEntry entry;
+    tuned_ = !tuning_file_.empty() && load_tuning(tuning_file_, tuning_key(), &entry);
+
+    if (tuned_) {
+        if (execution_mode_ == EXECUTION_AUTO) {
+            execution_mode_ = entry.execution_mode;
+        }
+        if (planner_rigor_ == PLANNER_DEFAULT) {
+            planner_rigor_ = entry.planner_rigor;
+        }
+        if (chunk_override_ == 0) {
+            chunk_override_ = entry.chunk_frames;
+        }
+        if (num_threads_ == 0) {
+            num_threads_ = entry.num_threads;
+        }
+    }
+
+    if (planner_rigor_ == PLANNER_DEFAULT) {
+        planner_rigor_ = PLANNER_MEASURE;
+    }
+    if (num_threads_ < 1) {
+        num_threads_ = 1;
+    }
+}
+
+TuningKey STFT::tuning_key() const {
+    TuningKey key;
+    key.data_size        = data_size_;
+    key.transform_length = transform_length_;
+    key.window_length    = window_length_;
+    key.window_overlap   = window_overlap_;
+    key.window_type      = window_type_;
+    key.windows_log2     = 0;
+    for (size_t windows = num_windows_; windows > 1; windows /= 2) {
+        key.windows_log2++;
+    }
+    return key;
+}
+
 void STFT::calc_num_frequencies() {
-    if (transform_length_ % 2 == 0) {
+    if (constant_q()) {
+        num_frequencies_ = ConstantQKernel::count_bins(bins_per_octave_, min_frequency_, max_frequency_);
+    } else if (transform_length_ % 2 == 0) {
         num_frequencies_ = transform_length_ / 2 + 1;
     } else {
         num_frequencies_ = (transform_length_ + 1) / 2;
     }
 }
 
-// Allocate the internal buffer to hold segmented data / Fourier spectra, and FFTW plan
+// Resolve the constant-Q frequency range, and lengthen segments to hold the kernel of the lowest bin
+//
+// Each bin's kernel spans Q cycles of its centre frequency, so the lowest bin needs the longest segment. Segments are
+// lengthened keeping the hop, so the time resolution is unchanged.
+void STFT::configure_constant_q() {
+    const double quality = ConstantQKernel::quality(bins_per_octave_);
+    const double nyquist = sample_rate_ / 2.0;
+
+    if (max_frequency_ > nyquist) {
+        fprintf(stderr, "WARNING: Maximum frequency cannot exceed the Nyquist frequency. Setting to Nyquist.");
+    }
+    if (max_frequency_ <= 0.0 || max_frequency_ > nyquist) {
+        max_frequency_ = nyquist;
+    }
+
+    if (min_frequency_ <= 0.0) {
+        min_frequency_ = quality * sample_rate_ / window_length_;
+    }
+    if (min_frequency_ > max_frequency_) {
+        fprintf(stderr, "WARNING: Minimum frequency cannot exceed the maximum frequency. Setting to maximum.");
+        min_frequency_ = max_frequency_;
+    }
+
+    const size_t kernel_length = (size_t)ceil(quality * sample_rate_ / min_frequency_);
+    if (kernel_length > window_length_) {
+        fprintf(stderr, "WARNING: Window length is shorter than the lowest constant-Q kernel. Setting to its length.");
+        window_overlap_ += kernel_length - window_length_;
+        window_length_    = kernel_length;
+        transform_length_ = std::max(transform_length_, window_length_);
+    }
+}
+
+// Resolve the execution mode by comparing the approximate cost per segment of each mode
+void STFT::select_execution_mode() {
+    double       alpha[4];
+    const size_t num_terms = cosine_sum_terms(window_type_, alpha);
+
+    if (execution_mode_ == EXECUTION_SLIDING_DFT && num_terms == 0) {
+        fprintf(stderr, "WARNING: Sliding DFT requires a cosine-sum window. Setting to FFT.");
+        execution_mode_ = EXECUTION_FFT;
+    }
+
+    // The sliding DFT carries every segment over to the next, so skipping segments needs independent FFTs
+    if (gated()) {
+        if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+            fprintf(stderr, "WARNING: Energy gate requires FFT execution. Setting to FFT.");
+        }
+        execution_mode_ = EXECUTION_FFT;
+    }
+
+    // Likewise, each segment's own trend is removed before it is transformed
+    if (preprocessed()) {
+        if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+            fprintf(stderr, "WARNING: Detrending and pre-emphasis require FFT execution. Setting to FFT.");
+        }
+        execution_mode_ = EXECUTION_FFT;
+    }
+
+    // The constant-Q kernel is applied to whole spectra
+    if (constant_q()) {
+        if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+            fprintf(stderr, "WARNING: Constant-Q transforms require FFT execution. Setting to FFT.");
+        }
+        execution_mode_ = EXECUTION_FFT;
+    }
+
+    if (execution_mode_ != EXECUTION_AUTO) {
+        return;
+    }
+
+    execution_mode_ = EXECUTION_FFT;
+    if (num_terms == 0 || num_windows_ < 2) {
+        return;
+    }
+
+    // Each bin is the sum of (2 * terms - 1) complex recursions, updated once per sample of window increment and
+    // periodically re-anchored with one real FFT per recursion
+    const double window_increment = (double)(window_length_ - window_overlap_);
+    const double num_recursions   = 2.0 * num_terms - 1.0;
+    const double anchor_interval  = ceil(kSlidingDFTAnchorSamples / window_increment);
+    const double fft_cost         = 2.5 * transform_length_ * log2((double)transform_length_) + window_length_;
+    const double sdft_cost        = num_frequencies_ * num_recursions * (8.0 * window_increment + 2.0) +
+                             num_recursions * fft_cost / anchor_interval;
+
+    if (sdft_cost < fft_cost) {
+        execution_mode_ = EXECUTION_SLIDING_DFT;
+    }
+}
+
+// Allocate the internal buffer to hold segmented data / Fourier spectra, and FFT plans
+//
+// Segments are transformed in chunks of bounded size. A second plan covers the remainder when the number of segments
+// is not a multiple of the chunk size.
 void STFT::init_fft() {
-    // Set FFT parameters
-    const int           wid[]    = {(int)transform_length_};
-    unsigned int        flags    = FFTW_MEASURE | FFTW_PRESERVE_INPUT;
-    const fftw_r2r_kind fft_kind = FFTW_R2HC;
+    // Allocate
+    workspace_ = create_workspace();
 
-    if (isFloat()) {
-        // Allocate
-        fourier_spectra_ = fftwf_malloc(sizeof(float) * num_windows_ * transform_length_);
+    if (!tuning_file_.empty()) {
+        fft_backend_->load_wisdom(tuning_file_, data_size_);
+    }
+
+    if (chunk_frames_ > 0) {
+        if (isFloat()) {
+            fftf_plan_ = plan_frames(chunk_frames_, (float*)workspace_->fourier_spectra);
+            if (tail_frames_ > 0) {
+                fftf_plan_tail_ = plan_frames(tail_frames_, (float*)workspace_->fourier_spectra);
+            }
+
+        } else if (isDouble()) {
+            fft_plan_ = plan_frames(chunk_frames_, (double*)workspace_->fourier_spectra);
+            if (tail_frames_ > 0) {
+                fft_plan_tail_ = plan_frames(tail_frames_, (double*)workspace_->fourier_spectra);
+            }
+        }
+    }
+
+    // Single-segment plan used to anchor the sliding DFT, or to transform the segments passing the energy gate in
+    // place within a chunk
+    if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+        if (isFloat()) {
+            fftf_plan_single_ = plan_frames(1, (float*)workspace_->frame_buffer);
+        } else if (isDouble()) {
+            fft_plan_single_ = plan_frames(1, (double*)workspace_->frame_buffer);
+        }
+
+    } else if (gated() && chunk_frames_ > 0) {
+        if (isFloat()) {
+            fftf_plan_single_ = plan_frames(1, (float*)workspace_->fourier_spectra, true);
+        } else if (isDouble()) {
+            fft_plan_single_ = plan_frames(1, (double*)workspace_->fourier_spectra, true);
+        }
+    }
+
+    if (!tuning_file_.empty() && planner_rigor_ != PLANNER_ESTIMATE) {
+        fft_backend_->save_wisdom(tuning_file_, data_size_);
+    }
+}
+
+// Create the inverse plans on first use, in chunks and a tail like the forward plans. Planning may overwrite its
+// buffer, so a scratch chunk is planned on.
+void STFT::init_inverse_fft() {
+    const bool planned = isFloat() ? fftf_plan_inverse_ != NULL : fft_plan_inverse_ != NULL;
+    if (planned || chunk_frames_ == 0) {
+        return;
+    }
 
-        // Create FFT plan
-        fftwf_plan_ = fftwf_plan_many_r2r(1, wid, (int)num_windows_, (float*)fourier_spectra_, NULL, 1,
-                                          (int)transform_length_, (float*)fourier_spectra_, NULL, 1,
-                                          (int)transform_length_, &fft_kind, flags);
+    inverse_blocks_.resize(std::max(num_threads_, 1));
+    for (void*& block : inverse_blocks_) {
+        block = fft_backend_->allocate(data_size_ * chunk_frames_ * transform_length_);
+    }
+
+    void* buffer = inverse_blocks_[0];
+    if (isFloat()) {
+        fftf_plan_inverse_ = plan_frames(chunk_frames_, (float*)buffer, false, FFT_INVERSE);
+        if (tail_frames_ > 0) {
+            fftf_plan_inverse_tail_ = plan_frames(tail_frames_, (float*)buffer, false, FFT_INVERSE);
+        }
 
     } else if (isDouble()) {
-        // Allocate
-        fourier_spectra_ = fftw_malloc(sizeof(double) * num_windows_ * transform_length_);
+        fft_plan_inverse_ = plan_frames(chunk_frames_, (double*)buffer, false, FFT_INVERSE);
+        if (tail_frames_ > 0) {
+            fft_plan_inverse_tail_ = plan_frames(tail_frames_, (double*)buffer, false, FFT_INVERSE);
+        }
+    }
+}
+
+// Allocate the buffers written during an execution
+//
+// The backend's allocator guarantees every workspace has the alignment the plans were created with, so the plans can
+// be executed on any workspace
+STFTWorkspace* STFT::create_workspace() const {
+    STFTWorkspace* workspace = new STFTWorkspace();
+    const size_t   length    = (tiled_ ? chunk_frames_ : num_windows_) * transform_length_;
+
+    workspace->fourier_spectra = fft_backend_->allocate(data_size_ * length);
+
+    if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+        workspace->frame_buffer = fft_backend_->allocate(data_size_ * transform_length_);
+        workspace->anchor_spectra.resize(transform_length_);
+        workspace->sdft_state.resize(sdft_rotation_.size());
+    }
+
+    if (gated()) {
+        workspace->frame_active.assign(num_windows_, 1);
+    }
+
+    init_scratch(workspace->scratch);
+
+    return workspace;
+}
+
+// Allocate one scratch per thread: prefix sums over the samples of up to chunk_frames_ segments for the energy gate,
+// the pre-emphasized samples of up to a batch chunk and their prefix sums for detrending, the resampled samples of up
+// to a batch chunk and the resampler's state, a row of constant-Q coefficients and the scratch of FFT plan executions
+void STFT::init_scratch(std::vector<STFTScratch>& scratch) const {
+    const size_t window_increment     = window_length_ - window_overlap_;
+    const size_t preprocessed_samples = std::max(chunk_frames_, batch_frames_) * window_increment + window_length_;
+
+    scratch.resize(std::max(num_threads_, 1));
+    for (STFTScratch& thread_scratch : scratch) {
+        if (gated()) {
+            thread_scratch.prefix.resize(chunk_frames_ * window_increment + window_length_ + 1);
+        }
+        if (preprocessed()) {
+            thread_scratch.emphasized.resize(preprocessed_samples);
+            thread_scratch.sums.resize(detrend_ != DETREND_NONE ? preprocessed_samples + 1 : 0);
+            thread_scratch.moments.resize(detrend_ == DETREND_LINEAR ? preprocessed_samples + 1 : 0);
+        }
+        if (resampler_) {
+            thread_scratch.resampled.resize(data_size_ * (preprocessed_samples + 1));
+            resampler_->reset(thread_scratch.resampler);
+        }
+        thread_scratch.constant_q.resize(2 * (constant_q() ? num_frequencies_ : 0));
+        thread_scratch.fft.resize(data_size_ * fft_scratch_size());
+    }
+}
+
+// Scratch values enough for any plan the transform executes, including those created on first use
+size_t STFT::fft_scratch_size() const {
+    size_t values = 0;
+    for (size_t num_frames : {chunk_frames_, tail_frames_, (size_t)1, batch_frames_}) {
+        for (FFTKind kind : {FFT_FORWARD, FFT_INVERSE}) {
+            const FFTBackend::PlanConfig plan_config = {transform_length_, num_frames, kind, planner_rigor_, false};
+            values = std::max(values, fft_backend_->scratch_size(plan_config));
+        }
+    }
+    return values;
+}
+
+void STFT::destroy_workspace(STFTWorkspace* workspace) const {
+    if (!workspace) {
+        return;
+    }
+
+    fft_backend_->release(workspace->fourier_spectra);
+    fft_backend_->release(workspace->frame_buffer);
+
+    delete workspace;
+}
+
+// Precompute the per-bin recursion coefficients of the sliding DFT
+//
+// A cosine-sum window is a sum of complex exponentials, w[m] = sum_r c_r exp(2 pi j r m / (N - 1)) for
+// r = -(terms-1)...(terms-1), so each windowed bin X_k is the weighted sum of rectangular-window DFTs Y_{k,r} evaluated
+// at the frequency f = k / transform_length - r / (N - 1). Each Y_{k,r} slides by one sample in O(1):
+//     Y(s + 1) = exp(2 pi j f) * (Y(s) - x[s] + x[s + N] * exp(-2 pi j f N))
+void STFT::init_sliding_dft() {
+    if (execution_mode_ != EXECUTION_SLIDING_DFT) {
+        return;
+    }
+
+    double alpha[4] = {0.0, 0.0, 0.0, 0.0};
+    sdft_num_terms_ = cosine_sum_terms(window_type_, alpha);
 
-        // Create FFT plan
-        fftw_plan_ = fftw_plan_many_r2r(1, wid, (int)num_windows_, (double*)fourier_spectra_, NULL, 1,
-                                        (int)transform_length_, (double*)fourier_spectra_, NULL, 1,
-                                        (int)transform_length_, &fft_kind, flags);
+    const size_t window_increment = window_length_ - window_overlap_;
+    sdft_anchor_interval_ = (kSlidingDFTAnchorSamples + window_increment - 1) / window_increment;
+
+    const size_t num_recursions = 2 * sdft_num_terms_ - 1;
+    sdft_weights_.resize(num_recursions);
+    sdft_rotation_.resize(num_frequencies_ * num_recursions);
+    sdft_entry_.resize(num_frequencies_ * num_recursions);
+
+    for (size_t i = 0; i < num_recursions; i++) {
+        const size_t order = (i < sdft_num_terms_) ? sdft_num_terms_ - 1 - i : i - (sdft_num_terms_ - 1);
+        const double sign  = (order % 2 == 0) ? 1.0 : -1.0;
+        sdft_weights_[i]   = (order == 0) ? alpha[0] : sign * alpha[order] / 2.0;
+    }
+
+    for (size_t k = 0; k < num_frequencies_; k++) {
+        for (size_t i = 0; i < num_recursions; i++) {
+            const double r     = (double)i - (double)(sdft_num_terms_ - 1);
+            const double f     = (double)k / transform_length_ - r / (window_length_ - 1);
+            const double angle = 2.0 * M_PI * f;
+
+            sdft_rotation_[k * num_recursions + i] = std::polar(1.0, angle);
+            sdft_entry_[k * num_recursions + i]    = std::polar(1.0, -angle * (double)window_length_);
+        }
     }
 }
 
 void STFT::init_window_coefs() {
     window_coefs_.resize(window_length_);
 
-    unsigned long i;
-    double        x, alpha, beta, alpha0, alpha1, alpha2, alpha3;
-    const double  mult = (2.0 * M_PI) / (window_length_ - 1);
+    size_t       i, r;
+    double       x, alpha[4];
+    const double mult      = (2.0 * M_PI) / (window_length_ - 1);
+    const size_t num_terms = cosine_sum_terms(window_type_, alpha);
 
     switch (window_type_) {
-        case RECTANGULAR:
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = 1.0;
-            }
-            break;
-
         case TRIANGULAR:
             for (i = 0; i < ceil(window_length_ / 2.0); i++) {
                 if (window_length_ % 2 == 0) {
@@ -164,65 +778,19 @@ void STFT::init_window_coefs() {
             }
             break;
 
-        case HANN:
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = 0.5 - 0.5 * cos(i * mult);
-            }
-            break;
-
-        case HAMMING:
-            alpha = 25.0 / 46.0;
-            beta  = 21.0 / 46.0;
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = alpha - beta * cos(i * mult);
-            }
-            break;
-
-        case BLACKMAN:
-            alpha0 = 7938.0 / 18608.0;
-            alpha1 = 9240.0 / 18608.0;
-            alpha2 = 1430.0 / 18608.0;
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = alpha0 - alpha1 * cos(i * mult) + alpha2 * cos(2.0 * i * mult);
-            }
-            break;
-
-        case NUTTALL:
-            alpha0 = 0.355768;
-            alpha1 = 0.487396;
-            alpha2 = 0.144232;
-            alpha3 = 0.012604;
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = alpha0 - alpha1 * cos(i * mult) + alpha2 * cos(2.0 * i * mult) -
-                                   alpha3 * cos(3.0 * i * mult);
-            }
-            break;
-
-        case BLACKMAN_NUTTALL:
-            alpha0 = 0.3635819;
-            alpha1 = 0.4891775;
-            alpha2 = 0.1365995;
-            alpha3 = 0.0106411;
-            for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = alpha0 - alpha1 * cos(i * mult) + alpha2 * cos(2.0 * i * mult) -
-                                   alpha3 * cos(3.0 * i * mult);
+        default:
+            if (num_terms == 0) {
+                throw "Unknown window";
             }
-            break;
 
-        case BLACKMAN_HARRIS:
-            alpha0 = 0.35875;
-            alpha1 = 0.48829;
-            alpha2 = 0.14128;
-            alpha3 = 0.01168;
+            // Generalized cosine-sum windows (rectangular, Hann, Hamming, Blackman and variants)
             for (i = 0; i < window_length_; i++) {
-                window_coefs_[i] = alpha0 - alpha1 * cos(i * mult) + alpha2 * cos(2.0 * i * mult) -
-                                   alpha3 * cos(3.0 * i * mult);
+                window_coefs_[i] = alpha[0];
+                for (r = 1; r < num_terms; r++) {
+                    window_coefs_[i] += ((r % 2 == 0) ? 1.0 : -1.0) * alpha[r] * cos((double)r * i * mult);
+                }
             }
             break;
-
-        default:
-            throw "Unknown window";
-            break;
     }
 
     // Compute the scaling factor from the window coefficients
@@ -231,6 +799,20 @@ void STFT::init_window_coefs() {
         coef_sq += window_coefs_[i] * window_coefs_[i];
 
     scale_factor_ = 1.0 / (sample_rate_ * coef_sq);
+
+    // One-sided power spectrum: bins with a negative-frequency mirror count twice
+    power_weights_.assign(num_frequencies_, 2.0 * scale_factor_);
+    power_weights_[0] = scale_factor_;
+    if (transform_length_ % 2 == 0) {
+        power_weights_[num_frequencies_ - 1] = scale_factor_;
+    }
+
+    // Constant-Q kernels carry their own windows and are normalized so that a sinusoid at a bin's centre frequency has
+    // coefficients of half its amplitude. Bins then report its mean square.
+    if (constant_q()) {
+        window_coefs_.assign(window_length_, 1.0);
+        power_weights_.assign(num_frequencies_, 2.0);
+    }
 }
 
 // Create output time vector
@@ -240,76 +822,764 @@ void STFT::init_time() {
     const double time_increment = (window_length_ - window_overlap_) / sample_rate_;
     const double time_offset    = (window_length_ - 1) / (2.0 * sample_rate_);
 
-    for (unsigned long window = 0; window < num_windows_; window++) {
+    for (size_t window = 0; window < num_windows_; window++) {
         time_[window] = window * time_increment + time_offset;
     }
 }
 
 // Create output frequency vector
 void STFT::init_frequency() {
+    if (constant_q_kernel_) {
+        frequency_ = constant_q_kernel_->frequencies();
+        return;
+    }
+
     frequency_.resize(num_frequencies_);
 
     const double freq_resolution = sample_rate_ / transform_length_;
 
-    for (unsigned long freq_index = 0; freq_index < num_frequencies_; freq_index++) {
+    for (size_t freq_index = 0; freq_index < num_frequencies_; freq_index++) {
         frequency_[freq_index] = freq_resolution * freq_index;
     }
 }
 
+// Outputs which inverse or cross the half-complex spectra need the linear frequency bins that constant-Q transforms
+// replace. Other outputs read the interleaved coefficients like extract.
+bool STFT::half_complex(const char* output) const {
+    if (constant_q()) {
+        fprintf(stderr, "WARNING: %s is not available for constant-Q transforms. Ignoring.", output);
+        return false;
+    }
+    return true;
+}
+
 // Perform segmentation and windowing of input data, then calculate FFTs
 void STFT::compute(void* vsignal) {
-    // Check input
-    if (num_windows_ < 1) {
+    // Invalidate cached outputs
+    execution_count_++;
+
+    compute(vsignal, *workspace_);
+}
+
+// Compute into a caller-supplied workspace. Only reads the transform, so concurrent calls are safe as long as each
+// uses its own workspace.
+void STFT::compute(const void* vsignal, STFTWorkspace& workspace) const {
+    workspace.signal = vsignal;
+    reset_resampler(workspace.scratch);
+
+    // Check input. Tiled transforms compute the spectra from the signal as outputs are requested.
+    if (num_windows_ < 1 || tiled_) {
         return;
     }
 
-    unsigned long window_increment = window_length_ - window_overlap_;
-    unsigned long input_index;
+    // The sliding DFT reads the whole signal in order, so it is resampled up front. FFTs resample a chunk at a time.
+    if (execution_mode_ == EXECUTION_SLIDING_DFT) {
+        vsignal = resample(vsignal, input_samples_, workspace.resampled_signal);
+        if (isFloat()) {
+            compute_sliding_dft<float>((const float*)vsignal, workspace);
+        } else if (isDouble()) {
+            compute_sliding_dft<double>((const double*)vsignal, workspace);
+        }
+
+    } else {
+        if (isFloat()) {
+            compute_fft<float>((const float*)vsignal, workspace);
+        } else if (isDouble()) {
+            compute_fft<double>((const double*)vsignal, workspace);
+        }
+    }
+}
+
+// Resample a signal of num_samples input samples into the buffer. Without a resampler the signal is used as it is.
+const void* STFT::resample(const void* signal, size_t num_samples, std::vector<unsigned char>& buffer) const {
+    if (!resampler_) {
+        return signal;
+    }
 
+    buffer.resize(std::max(resampler_->output_length(num_samples), (size_t)1) * data_size_);
     if (isFloat()) {
-        float* signal          = (float*)vsignal;
-        float* fourier_spectra = (float*)fourier_spectra_;
+        resampler_->process<float>((const float*)signal, num_samples, input_stride_, (float*)buffer.data());
+    } else if (isDouble()) {
+        resampler_->process<double>((const double*)signal, num_samples, input_stride_, (double*)buffer.data());
+    }
+    return buffer.data();
+}
 
-        // Zero-out buffer
-        memset(fourier_spectra_, 0, sizeof(float) * num_windows_ * transform_length_);
+// The samples that num_rows segments from first_window are cut from, with the index of the first in origin. Without a
+// resampler the signal is used as it is. Otherwise the samples of the segments, and the one before them for
+// pre-emphasis, are resampled into the thread's scratch, reusing the filter input of the range it resampled last.
+template <typename T>
+const T* STFT::resample_rows(const T* signal, size_t input_samples, size_t first_window, size_t num_rows,
+                             STFTScratch& scratch, size_t& origin) const {
+    origin = 0;
+    if (!resampler_) {
+        return signal;
+    }
+
+    const size_t window_increment = window_length_ - window_overlap_;
+    const size_t first_sample     = first_window * window_increment;
+    const size_t last_sample      = (first_window + num_rows - 1) * window_increment + window_length_;
+    const size_t end_sample       = std::min(resampler_->output_length(input_samples), last_sample);
+    T*           samples          = (T*)scratch.resampled.data();
 
-        // Apply segmentation and windowing
-        for (unsigned long window = 0; window < num_windows_; window++) {
-            for (unsigned long sample = 0; sample < window_length_; sample++) {
-                input_index                                          = window * window_increment + sample;
-                fourier_spectra[window * transform_length_ + sample] = window_coefs_[sample] *
-                                                                       signal[stride_ * input_index];
+    origin = (first_sample > 0) ? first_sample - 1 : 0;
+    if (origin < end_sample) {
+        assert((end_sample - origin) * sizeof(T) <= scratch.resampled.size());
+        resampler_->process<T>(signal, input_samples, input_stride_, origin, end_sample, samples, scratch.resampler);
+    }
+    return samples;
+}
+template const float*  STFT::resample_rows(const float*, size_t, size_t, size_t, STFTScratch&, size_t&) const;
+template const double* STFT::resample_rows(const double*, size_t, size_t, size_t, STFTScratch&, size_t&) const;
+
+// Forget the filter input held by each thread's scratch, before resampling a signal whose samples may have changed
+void STFT::reset_resampler(std::vector<STFTScratch>& scratch) const {
+    if (resampler_) {
+        for (STFTScratch& thread_scratch : scratch) {
+            resampler_->reset(thread_scratch.resampler);
+        }
+    }
+}
+
+template <typename T>
+void STFT::compute_fft(const T* signal, STFTWorkspace& workspace) const {
+    T*           fourier_spectra = (T*)workspace.fourier_spectra;
+    const size_t num_chunks      = (num_windows_ + chunk_frames_ - 1) / chunk_frames_;
+
+    // Segment and transform one chunk at a time while it is still in cache. Chunks are independent, so they are
+    // spread across threads.
+    parallel_for_workers(num_chunks, num_threads_, [&](size_t chunk, size_t worker) {
+        const size_t   first_window = chunk * chunk_frames_;
+        const size_t   num_rows     = std::min(chunk_frames_, num_windows_ - first_window);
+        T*             block        = fourier_spectra + first_window * transform_length_;
+        unsigned char* active       = gated() ? workspace.frame_active.data() + first_window : NULL;
+
+        transform_block<T>(signal, first_window, num_rows, block, active, workspace.scratch[worker]);
+    });
+}
+template void STFT::compute_fft<float>(const float*, STFTWorkspace&) const;
+template void STFT::compute_fft<double>(const double*, STFTWorkspace&) const;
+
+// Execute on a ragged batch of clips. Row offsets of each clip's segments are found first, so that the batch can be
+// cut into whole chunks regardless of clip boundaries.
+size_t STFT::compute_batch(const SpectrogramClip* clips, size_t num_clips, size_t* offsets) {
+    // Segments are counted at the resampled rate
+    std::vector<size_t> first_rows(num_clips + 1, 0);
+    for (size_t clip = 0; clip < num_clips; clip++) {
+        first_rows[clip + 1] = first_rows[clip] + count_windows(resampled_samples(clips[clip].num_samples));
+    }
+    if (offsets) {
+        std::copy(first_rows.begin(), first_rows.end(), offsets);
+    }
+
+    batch_rows_ = 0;
+    if (chunk_frames_ == 0) {
+        fprintf(stderr, "WARNING: Transform has no segments to plan batches with. Skipping.");
+        return 0;
+    }
+
+    init_batch(first_rows[num_clips]);
+    if (isFloat()) {
+        compute_batch<float>(clips, num_clips, first_rows);
+    } else if (isDouble()) {
+        compute_batch<double>(clips, num_clips, first_rows);
+    }
+
+    return batch_rows_;
+}
+
+// Grow the batch buffer to hold num_rows segments in whole chunks. The buffer only grows, so batches of similar sizes
+// reuse it. The batch plan is created on the first buffer; later ones have the same alignment from the backend.
+void STFT::init_batch(size_t num_rows) {
+    const size_t num_chunks = (num_rows + batch_frames_ - 1) / batch_frames_;
+    if (num_chunks * batch_frames_ <= batch_capacity_) {
+        return;
+    }
+
+    batch_capacity_ = num_chunks * batch_frames_;
+    fft_backend_->release(batch_spectra_);
+    batch_spectra_ = fft_backend_->allocate(data_size_ * batch_capacity_ * transform_length_);
+    init_scratch(batch_scratch_);
+
+    if (isFloat() && !fftf_plan_batch_) {
+        fftf_plan_batch_ = plan_frames(batch_frames_, (float*)batch_spectra_);
+    } else if (isDouble() && !fft_plan_batch_) {
+        fft_plan_batch_ = plan_frames(batch_frames_, (double*)batch_spectra_);
+    }
+}
+
+template <typename T>
+void STFT::compute_batch(const SpectrogramClip* clips, size_t num_clips, const std::vector<size_t>& first_rows) {
+    const size_t num_rows   = first_rows[num_clips];
+    const size_t num_chunks = (num_rows + batch_frames_ - 1) / batch_frames_;
+
+    // Every chunk is transformed whole with the batch plan: rows past the last segment are zero. Clips are resampled a
+    // run of segments at a time.
+    T* fourier_spectra = (T*)batch_spectra_;
+    reset_resampler(batch_scratch_);
+    parallel_for_workers(num_chunks, num_threads_, [&](size_t chunk, size_t worker) {
+        const size_t first_row = chunk * batch_frames_;
+        const size_t end_row   = std::min(first_row + batch_frames_, num_rows);
+        T*           block     = fourier_spectra + first_row * transform_length_;
+        size_t       clip      = std::upper_bound(first_rows.begin(), first_rows.end(), first_row) - first_rows.begin();
+
+        for (size_t row = first_row; row < end_row;) {
+            // Skip the clips too short for a single segment
+            while (first_rows[clip] <= row) {
+                clip++;
             }
+
+            const SpectrogramClip& source       = clips[clip - 1];
+            const size_t           run          = std::min(first_rows[clip], end_row) - row;
+            const size_t           first_window = row - first_rows[clip - 1];
+            size_t                 origin;
+            const T*               samples = resample_rows<T>((const T*)source.data, source.num_samples, first_window,
+                                                              run, batch_scratch_[worker], origin);
+            segment<T>(samples, resampled_samples(source.num_samples), origin, first_window, run,
+                       fourier_spectra + row * transform_length_, batch_scratch_[worker]);
+            row += run;
         }
+        memset(fourier_spectra + end_row * transform_length_, 0,
+               sizeof(T) * (first_row + batch_frames_ - end_row) * transform_length_);
 
-        // Compute Fourier spectra in-place
-        fftwf_execute(fftwf_plan_);
+        execute_batch(block, batch_scratch_[worker]);
+        apply_constant_q(block, batch_frames_, batch_scratch_[worker]);
+    });
 
+    batch_rows_ = num_rows;
+}
+template void STFT::compute_batch<float>(const SpectrogramClip*, size_t, const std::vector<size_t>&);
+template void STFT::compute_batch<double>(const SpectrogramClip*, size_t, const std::vector<size_t>&);
+
+// Allocate a real-time stream: its segment buffer, a single-frame plan on an FFT buffer of its own, the plan's scratch
+// and the queue. Stages which keep state across segments are not supported.
+STFTRealtime* STFT::create_realtime(size_t queue_length) const {
+    if (resampler_ || preprocessed() || constant_q()) {
+        fprintf(stderr,
+                "WARNING: Real-time streams do not support resampling, detrending, pre-emphasis or constant-Q "
+                "transforms.");
+        return NULL;
+    }
+    if (queue_length < 1) {
+        fprintf(stderr, "WARNING: Real-time queue length must be at least 1. Setting to 1.");
+        queue_length = 1;
+    }
+
+    STFTRealtime* realtime = new STFTRealtime();
+    realtime->frame_buffer = fft_backend_->allocate(data_size_ * transform_length_);
+    realtime->pending.resize(data_size_ * window_length_);
+    realtime->queue_length = queue_length;
+    realtime->queue.resize(data_size_ * queue_length * num_frequencies_);
+    realtime->queue_frames.resize(queue_length);
+
+    if (isFloat()) {
+        realtime->fftf_plan = plan_frames(1, (float*)realtime->frame_buffer);
+        realtime->scratch.resize(sizeof(float) * realtime->fftf_plan->scratch_size());
     } else if (isDouble()) {
-        double* signal          = (double*)vsignal;
-        double* fourier_spectra = (double*)fourier_spectra_;
+        realtime->fft_plan = plan_frames(1, (double*)realtime->frame_buffer);
+        realtime->scratch.resize(sizeof(double) * realtime->fft_plan->scratch_size());
+    }
+
+    return realtime;
+}
+
+void STFT::destroy_realtime(STFTRealtime* realtime) const {
+    if (!realtime) {
+        return;
+    }
+
+    fft_backend_->release(realtime->frame_buffer);
+
+    delete realtime;
+}
+
+// Append samples to the segment being filled, transforming each segment as it completes. The overlap of the next
+// segment is kept by moving it to the front, so a push costs O(window_length) per completed segment.
+template <typename T>
+size_t STFT::push_realtime(STFTRealtime& realtime, const T* samples, size_t num_samples) const {
+    const size_t window_increment = window_length_ - window_overlap_;
+    T*           pending          = (T*)realtime.pending.data();
+    size_t       completed        = 0;
+
+    for (size_t sample = 0; sample < num_samples;) {
+        const size_t count = std::min(num_samples - sample, window_length_ - realtime.num_pending);
+        for (size_t index = 0; index < count; index++) {
+            pending[realtime.num_pending + index] = samples[stride_ * (sample + index)];
+        }
+        realtime.num_pending += count;
+        sample += count;
+
+        if (realtime.num_pending < window_length_) {
+            break;
+        }
+
+        transform_realtime<T>(realtime, pending);
+        memmove(pending, pending + window_increment, sizeof(T) * window_overlap_);
+        realtime.num_pending = window_overlap_;
+        completed++;
+    }
+
+    return completed;
+}
+template size_t STFT::push_realtime<float>(STFTRealtime&, const float*, size_t) const;
+template size_t STFT::push_realtime<double>(STFTRealtime&, const double*, size_t) const;
+
+// Transform a complete segment into the next free row of the queue, which is published to the consumer only once
+// written. Segments are dropped, untransformed, while the queue is full.
+template <typename T>
+void STFT::transform_realtime(STFTRealtime& realtime, const T* samples) const {
+    const size_t frame = realtime.num_frames++;
+    const size_t slot  = realtime.written.load(std::memory_order_relaxed);
+    if (slot - realtime.read.load(std::memory_order_acquire) >= realtime.queue_length) {
+        realtime.dropped.store(realtime.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    T*            power  = (T*)realtime.queue.data() + (slot % realtime.queue_length) * num_frequencies_;
+    unsigned char active = 1;
+    if (gated()) {
+        double energy = 0.0;
+        for (size_t sample = 0; sample < window_length_; sample++) {
+            energy += (double)samples[sample] * samples[sample];
+        }
+        active = (energy >= gate_threshold_ * window_length_) ? 1 : 0;
+    }
+
+    if (active) {
+        T* buffer = (T*)realtime.frame_buffer;
+        for (size_t sample = 0; sample < window_length_; sample++) {
+            buffer[sample] = window_coefs_[sample] * samples[sample];
+        }
+        std::fill(buffer + window_length_, buffer + transform_length_, (T)0);
+        execute_realtime(realtime, buffer);
+    }
+    extract<T>((const T*)realtime.frame_buffer, 1, power, NULL, gated() ? &active : NULL);
 
-        // Zero-out buffer
-        memset(fourier_spectra_, 0, sizeof(double) * num_windows_ * transform_length_);
+    realtime.queue_frames[slot % realtime.queue_length] = frame;
+    realtime.written.store(slot + 1, std::memory_order_release);
+}
+template void STFT::transform_realtime<float>(STFTRealtime&, const float*) const;
+template void STFT::transform_realtime<double>(STFTRealtime&, const double*) const;
+
+template <typename T>
+bool STFT::pop_realtime(STFTRealtime& realtime, T* power, size_t* frame) const {
+    const size_t slot = realtime.read.load(std::memory_order_relaxed);
+    if (slot == realtime.written.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const T* row = (const T*)realtime.queue.data() + (slot % realtime.queue_length) * num_frequencies_;
+    std::copy(row, row + num_frequencies_, power);
+    if (frame) {
+        *frame = realtime.queue_frames[slot % realtime.queue_length];
+    }
+
+    realtime.read.store(slot + 1, std::memory_order_release);
+    return true;
+}
+template bool STFT::pop_realtime<float>(STFTRealtime&, float*, size_t*) const;
+template bool STFT::pop_realtime<double>(STFTRealtime&, double*, size_t*) const;
+
+// Call visit(spectra, first_window, num_rows) on consecutive blocks of segments' spectra: the whole buffer at once, or
+// each chunk in turn, recomputed from the signal, for tiled transforms
+template <typename T, typename Visitor>
+void STFT::for_each_block(STFTWorkspace& workspace, Visitor visit) const {
+    T* fourier_spectra = (T*)workspace.fourier_spectra;
+
+    if (!tiled_) {
+        visit((const T*)fourier_spectra, (size_t)0, num_windows_);
+        return;
+    }
+
+    for (size_t first_window = 0; first_window < num_windows_; first_window += chunk_frames_) {
+        const size_t num_rows = std::min(chunk_frames_, num_windows_ - first_window);
+
+        unsigned char* active = gated() ? workspace.frame_active.data() + first_window : NULL;
+
+        transform_block<T>((const T*)workspace.signal, first_window, num_rows, fourier_spectra, active,
+                           workspace.scratch[0]);
+        visit((const T*)fourier_spectra, first_window, num_rows);
+    }
+}
+
+// Segment and transform consecutive segments into rows of the block
+//
+// With the energy gate enabled, the mean square sample of each segment is found from chunk-local prefix sums of
+// squares, kept in the thread's scratch, so overlapping segments cost O(1) each. Segments below the threshold are left
+// zero, marked inactive and not transformed. When only some segments of a chunk pass the gate, the chunk is segmented
+// once, skipping the inactive rows, and the active rows are transformed one at a time.
+template <typename T>
+void STFT::transform_block(const T* signal, size_t first_window, size_t num_rows, T* block, unsigned char* active,
+                           STFTScratch& scratch) const {
+    size_t origin;
+    signal = resample_rows<T>(signal, input_samples_, first_window, num_rows, scratch, origin);
+
+    if (!gated()) {
+        segment<T>(signal, num_samples_, origin, first_window, num_rows, block, scratch);
+        execute_frames(block, num_rows, scratch);
+        apply_constant_q(block, num_rows, scratch);
+        return;
+    }
+
+    const size_t window_increment = window_length_ - window_overlap_;
+    const size_t last_sample      = (first_window + num_rows - 1) * window_increment + window_length_;
+    const size_t first_sample     = first_window * window_increment;
+    const size_t end_sample       = std::min(num_samples_, last_sample);
+    const double threshold        = gate_threshold_ * window_length_;
+    double*      prefix           = scratch.prefix.data();
+
+    prefix[0] = 0.0;
+    for (size_t sample = first_sample; sample < end_sample; sample++) {
+        const double value                = signal[stride_ * (sample - origin)];
+        prefix[sample - first_sample + 1] = prefix[sample - first_sample] + value * value;
+    }
+
+    size_t num_active = 0;
+    for (size_t row = 0; row < num_rows; row++) {
+        const size_t start = (first_window + row) * window_increment - first_sample;
+        const size_t end   = std::min(start + window_length_, end_sample - first_sample);
+        active[row]        = (prefix[end] - prefix[start] >= threshold) ? 1 : 0;
+        num_active += active[row];
+    }
 
-        // Apply segmentation and windowing
-        for (unsigned long window = 0; window < num_windows_; window++) {
-            for (unsigned long sample = 0; sample < window_length_; sample++) {
-                input_index                                          = window * window_increment + sample;
-                fourier_spectra[window * transform_length_ + sample] = window_coefs_[sample] *
-                                                                       signal[stride_ * input_index];
+    if (num_active == num_rows) {
+        segment<T>(signal, num_samples_, origin, first_window, num_rows, block, scratch);
+        execute_frames(block, num_rows, scratch);
+        apply_constant_q(block, num_rows, scratch);
+        return;
+    }
+
+    segment<T>(signal, num_samples_, origin, first_window, num_rows, block, scratch, active);
+    for (size_t row = 0; row < num_rows; row++) {
+        if (active[row]) {
+            T* row_ptr = block + row * transform_length_;
+            execute_single(row_ptr, scratch);
+            apply_constant_q(row_ptr, 1, scratch);
+        }
+    }
+}
+template void STFT::transform_block<float>(const float*, size_t, size_t, float*, unsigned char*, STFTScratch&) const;
+template void STFT::transform_block<double>(const double*, size_t, size_t, double*, unsigned char*,
+                                            STFTScratch&) const;
+
+// Apply segmentation and windowing to consecutive segments, writing them to rows of the block. The signal holds the
+// samples from index origin on, and rows not marked in active, when given, are left zero.
+template <typename T>
+void STFT::segment(const T* signal, size_t num_samples, size_t origin, size_t first_window, size_t num_rows, T* block,
+                   STFTScratch& scratch, const unsigned char* active) const {
+    const size_t window_increment = window_length_ - window_overlap_;
+    size_t       input_index;
+    size_t       window_samples;
+
+    // Zero-out buffer
+    memset(block, 0, sizeof(T) * num_rows * transform_length_);
+
+    if (preprocessed()) {
+        segment_preprocessed<T>(signal, num_samples, origin, first_window, num_rows, block, scratch, active);
+        return;
+    }
+
+    // Segments past the end of the signal stay zero-padded
+    for (size_t row = 0; row < num_rows; row++) {
+        if (active && !active[row]) {
+            continue;
+        }
+        const size_t window = first_window + row;
+        window_samples      = std::min(window_length_, num_samples - window * window_increment);
+        for (size_t sample = 0; sample < window_samples; sample++) {
+            input_index                            = window * window_increment + sample;
+            block[row * transform_length_ + sample] = window_coefs_[sample] * signal[stride_ * (input_index - origin)];
+        }
+    }
+}
+template void STFT::segment<float>(const float*, size_t, size_t, size_t, size_t, float*, STFTScratch&,
+                                   const unsigned char*) const;
+template void STFT::segment<double>(const double*, size_t, size_t, size_t, size_t, double*, STFTScratch&,
+                                    const unsigned char*) const;
+
+// Segment and window a zeroed block, with pre-emphasis and detrending fused into the windowing loop
+//
+// The pre-emphasized samples covered by the block are computed once into the thread's scratch, along with chunk-local
+// prefix sums of y[i] and i * y[i]. The mean or least-squares line of each segment then follows from its sums in O(1),
+// however much segments overlap. Only the samples within the signal are fitted; padding stays zero.
+template <typename T>
+void STFT::segment_preprocessed(const T* signal, size_t num_samples, size_t origin, size_t first_window,
+                                size_t num_rows, T* block, STFTScratch& scratch, const unsigned char* active) const {
+    const size_t window_increment = window_length_ - window_overlap_;
+    const size_t first_sample     = first_window * window_increment;
+    const size_t end_sample = std::min(num_samples, (first_window + num_rows - 1) * window_increment + window_length_);
+    if (first_sample >= end_sample) {
+        return;
+    }
+
+    const size_t length = end_sample - first_sample;
+    assert(length <= scratch.emphasized.size());
+
+    double*      emphasized = scratch.emphasized.data();
+    double*      sums       = scratch.sums.data();
+    double*      moments    = scratch.moments.data();
+
+    double previous = (first_sample > 0) ? (double)signal[stride_ * (first_sample - 1 - origin)] : 0.0;
+    for (size_t index = 0; index < length; index++) {
+        const double value = signal[stride_ * (first_sample + index - origin)];
+        emphasized[index]  = value - pre_emphasis_ * previous;
+        previous           = value;
+    }
+    if (detrend_ != DETREND_NONE) {
+        sums[0] = 0.0;
+        for (size_t index = 0; index < length; index++) {
+            sums[index + 1] = sums[index] + emphasized[index];
+        }
+    }
+    if (detrend_ == DETREND_LINEAR) {
+        moments[0] = 0.0;
+        for (size_t index = 0; index < length; index++) {
+            moments[index + 1] = moments[index] + index * emphasized[index];
+        }
+    }
+
+    for (size_t row = 0; row < num_rows; row++) {
+        const size_t start = (first_window + row) * window_increment - first_sample;
+        if (first_sample + start >= end_sample) {
+            break;
+        }
+        if (active && !active[row]) {
+            continue;
+        }
+
+        // Fit y[m] ~ offset + slope * m over the segment's samples m = 0...n-1
+        const size_t n      = std::min(window_length_, length - start);
+        double       offset = 0.0;
+        double       slope  = 0.0;
+        if (detrend_ != DETREND_NONE) {
+            const double sum = sums[start + n] - sums[start];
+            offset           = sum / n;
+
+            if (detrend_ == DETREND_LINEAR && n > 1) {
+                const double moment     = moments[start + n] - moments[start] - start * sum;
+                const double index_sum  = 0.5 * n * (n - 1.0);
+                const double square_sum = (n - 1.0) * n * (2.0 * n - 1.0) / 6.0;
+                slope                   = (n * moment - index_sum * sum) / (n * square_sum - index_sum * index_sum);
+                offset                  = (sum - slope * index_sum) / n;
+            }
+        }
+
+        T*            row_ptr = block + row * transform_length_;
+        const double* samples = emphasized + start;
+        for (size_t sample = 0; sample < n; sample++) {
+            row_ptr[sample] = window_coefs_[sample] * (samples[sample] - offset - slope * sample);
+        }
+    }
+}
+template void STFT::segment_preprocessed<float>(const float*, size_t, size_t, size_t, size_t, float*, STFTScratch&,
+                                                const unsigned char*) const;
+template void STFT::segment_preprocessed<double>(const double*, size_t, size_t, size_t, size_t, double*,
+                                                 STFTScratch&, const unsigned char*) const;
+
+// Bind a signal for range queries, discarding tiles computed from the previous one
+void STFT::bind(const void* signal) {
+    bound_signal_ = signal;
+    reset_resampler(workspace_->scratch);
+    tiles_.clear();
+    tile_lookup_.clear();
+
+    if (tile_spectra_ || chunk_frames_ == 0) {
+        return;
+    }
+
+    tile_spectra_ = fft_backend_->allocate(data_size_ * chunk_frames_ * transform_length_);
+}
+
+// Segment k covers the samples [k * increment, k * increment + length), and overlaps the range if it starts before
+// the end of the range and ends after its start
+size_t STFT::range_windows(double start_time, double end_time, size_t* first_window) const {
+    const double increment    = (double)(window_length_ - window_overlap_);
+    const double start_sample = start_time * sample_rate_;
+    const double end_sample   = end_time * sample_rate_;
+    size_t       first        = 0;
+    size_t       last         = 0;
+
+    if (start_sample > (double)window_length_) {
+        first = (size_t)floor((start_sample - window_length_) / increment) + 1;
+    }
+    if (end_sample > 0.0) {
+        last = (size_t)ceil(end_sample / increment);
+    }
+
+    first         = std::min(first, num_windows_);
+    last          = std::min(last, num_windows_);
+    *first_window = first;
+
+    return (last > first) ? last - first : 0;
+}
+
+// Get the power of one tile, transforming it if it is not cached
+template <typename T>
+const T* STFT::power_tile(size_t tile) {
+    auto cached = tile_lookup_.find(tile);
+    if (cached != tile_lookup_.end()) {
+        tiles_.splice(tiles_.begin(), tiles_, cached->second);
+        return (const T*)cached->second->power.data();
+    }
+
+    // Reuse the storage of the least recently used tile once the cache is full
+    if (tiles_.size() >= max_tiles_) {
+        tile_lookup_.erase(tiles_.back().index);
+        tiles_.splice(tiles_.begin(), tiles_, std::prev(tiles_.end()));
+    } else {
+        tiles_.emplace_front();
+    }
+
+    const size_t first_window = tile * chunk_frames_;
+    const size_t num_rows     = std::min(chunk_frames_, num_windows_ - first_window);
+    PowerTile&   entry        = tiles_.front();
+    entry.index               = tile;
+    entry.power.resize(sizeof(T) * chunk_frames_ * num_frequencies_);
+    tile_lookup_[tile] = tiles_.begin();
+
+    std::vector<unsigned char> active(gated() ? num_rows : 0);
+
+    transform_block<T>((const T*)bound_signal_, first_window, num_rows, (T*)tile_spectra_,
+                       gated() ? active.data() : NULL, workspace_->scratch[0]);
+    extract<T>((const T*)tile_spectra_, num_rows, (T*)entry.power.data(), NULL, gated() ? active.data() : NULL);
+
+    return (const T*)entry.power.data();
+}
+template const float*  STFT::power_tile(size_t);
+template const double* STFT::power_tile(size_t);
+
+// Copy the power of the segments overlapping a time range, transforming only tiles which are not cached
+template <typename T>
+void STFT::get_power_range(double start_time, double end_time, void* vout_ptr) {
+    T*           out_ptr  = (T*)vout_ptr;
+    size_t       first_window;
+    const size_t num_rows = range_windows(start_time, end_time, &first_window);
+
+    if (num_rows == 0) {
+        return;
+    }
+
+    if (!bound_signal_) {
+        fprintf(stderr, "WARNING: No signal is bound to the transform. Call bind before range queries.");
+        return;
+    }
+
+    const size_t end_window = first_window + num_rows;
+    for (size_t window = first_window; window < end_window;) {
+        const size_t tile      = window / chunk_frames_;
+        const size_t tile_end  = std::min((tile + 1) * chunk_frames_, end_window);
+        const T*     tile_rows = power_tile<T>(tile) + (window - tile * chunk_frames_) * num_frequencies_;
+
+        memcpy(out_ptr, tile_rows, sizeof(T) * (tile_end - window) * num_frequencies_);
+        out_ptr += (tile_end - window) * num_frequencies_;
+        window = tile_end;
+    }
+}
+template void STFT::get_power_range<float>(double, double, void*);
+template void STFT::get_power_range<double>(double, double, void*);
+
+// Reset the sliding DFT recursions to the exact spectra of the segment beginning at sample 'start'
+//
+// Each recursion is the DFT of the segment modulated by exp(2 pi j r m / (N - 1)), obtained from the real FFTs of the
+// cosine- and sine-modulated segments
+template <typename T>
+void STFT::anchor_sliding_dft(const T* signal, size_t start, STFTWorkspace& workspace) const {
+    const size_t num_recursions = 2 * sdft_num_terms_ - 1;
+    const size_t center         = sdft_num_terms_ - 1;
+    const size_t num_valid      = start < num_samples_ ? std::min(window_length_, num_samples_ - start) : 0;
+    const double mult           = (2.0 * M_PI) / (window_length_ - 1);
+    T*           buffer         = (T*)workspace.frame_buffer;
+    double*      cos_spectra    = workspace.anchor_spectra.data();
+
+    for (size_t r = 0; r < sdft_num_terms_; r++) {
+        // Real part of the modulated segment
+        memset(buffer, 0, sizeof(T) * transform_length_);
+        for (size_t m = 0; m < num_valid; m++) {
+            buffer[m] = signal[stride_ * (start + m)] * cos((double)r * m * mult);
+        }
+        execute_single(buffer, workspace.scratch[0]);
+        std::copy(buffer, buffer + transform_length_, cos_spectra);
+
+        // Imaginary part of the modulated segment
+        memset(buffer, 0, sizeof(T) * transform_length_);
+        if (r > 0) {
+            for (size_t m = 0; m < num_valid; m++) {
+                buffer[m] = signal[stride_ * (start + m)] * sin((double)r * m * mult);
+            }
+            execute_single(buffer, workspace.scratch[0]);
+        }
+
+        for (size_t k = 0; k < num_frequencies_; k++) {
+            const bool           has_imag = (k > 0) && (k < transform_length_ - k);
+            std::complex<double> a(cos_spectra[k], has_imag ? cos_spectra[transform_length_ - k] : 0.0);
+            std::complex<double> b(buffer[k], has_imag ? buffer[transform_length_ - k] : 0.0);
+
+            // DFT of x*exp(+j theta) is A + jB, DFT of x*exp(-j theta) is A - jB
+            std::complex<double>* state = &workspace.sdft_state[k * num_recursions];
+            state[center + r]           = a + std::complex<double>(0.0, 1.0) * b;
+            state[center - r]           = a - std::complex<double>(0.0, 1.0) * b;
+        }
+    }
+}
+template void STFT::anchor_sliding_dft<float>(const float*, size_t, STFTWorkspace&) const;
+template void STFT::anchor_sliding_dft<double>(const double*, size_t, STFTWorkspace&) const;
+
+// Compute the spectra of every segment with the sliding DFT, writing them in FFTW's half-complex layout
+template <typename T>
+void STFT::compute_sliding_dft(const T* signal, STFTWorkspace& workspace) const {
+    const size_t          num_recursions   = 2 * sdft_num_terms_ - 1;
+    const size_t          window_increment = window_length_ - window_overlap_;
+    T*                    fourier_spectra  = (T*)workspace.fourier_spectra;
+    std::complex<double>* state            = workspace.sdft_state.data();
+
+    memset(fourier_spectra, 0, sizeof(T) * num_windows_ * transform_length_);
+
+    for (size_t window = 0; window < num_windows_; window++) {
+        const size_t start = window * window_increment;
+
+        if (window % sdft_anchor_interval_ == 0) {
+            anchor_sliding_dft<T>(signal, start, workspace);
+
+        } else {
+            // Slide each recursion forward by one window increment
+            for (size_t s = start - window_increment; s < start; s++) {
+                const double leaving  = (s < num_samples_) ? signal[stride_ * s] : 0.0;
+                const double entering = (s + window_length_ < num_samples_) ? signal[stride_ * (s + window_length_)]
+                                                                              : 0.0;
+
+                // Written out explicitly to avoid the NaN-handling slow path of std::complex multiplication
+                for (size_t i = 0; i < num_frequencies_ * num_recursions; i++) {
+                    const double re = state[i].real() - leaving + entering * sdft_entry_[i].real();
+                    const double im = state[i].imag() + entering * sdft_entry_[i].imag();
+                    const std::complex<double>& rotation = sdft_rotation_[i];
+                    state[i] = std::complex<double>(rotation.real() * re - rotation.imag() * im,
+                                                    rotation.real() * im + rotation.imag() * re);
+                }
             }
         }
 
-        // Compute Fourier spectra in-place
-        fftw_execute(fftw_plan_);
+        // Combine the recursions into the windowed spectrum
+        T* row = fourier_spectra + window * transform_length_;
+        for (size_t k = 0; k < num_frequencies_; k++) {
+            std::complex<double> bin(0.0, 0.0);
+            for (size_t i = 0; i < num_recursions; i++) {
+                bin += sdft_weights_[i] * state[k * num_recursions + i];
+            }
+
+            row[k] = bin.real();
+            if (k > 0 && k < transform_length_ - k) {
+                row[transform_length_ - k] = bin.imag();
+            }
+        }
     }
 }
+template void STFT::compute_sliding_dft<float>(const float*, STFTWorkspace&) const;
+template void STFT::compute_sliding_dft<double>(const double*, STFTWorkspace&) const;
 
 template <typename T>
 void STFT::get_time(void* vout_ptr) {
     T* out_ptr = (T*)vout_ptr;
-    for (unsigned long window_index = 0; window_index < num_windows_; window_index++)
+    for (size_t window_index = 0; window_index < num_windows_; window_index++)
         out_ptr[window_index] = time_[window_index];
 }
 template void STFT::get_time<float>(void*);
@@ -318,157 +1588,982 @@ template void STFT::get_time<double>(void*);
 template <typename T>
 void STFT::get_freq(void* vout_ptr) {
     T* out_ptr = (T*)vout_ptr;
-    for (unsigned long frequency_index = 0; frequency_index < num_frequencies_; frequency_index++)
+    for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++)
         out_ptr[frequency_index] = frequency_[frequency_index];
 }
 template void STFT::get_freq<float>(void*);
 template void STFT::get_freq<double>(void*);
 
+// Convert a block of half-complex spectra to power and/or phase, reading each complex bin once
+//
+// FFTW's half-complex layout stores the real parts of bins 0...n/2 followed by the imaginary parts of bins
+// (n+1)/2-1...1 in reverse order. DC (and Nyquist for even lengths) have no imaginary part.
 template <typename T>
-void STFT::get_power(void* vout_ptr) {
-    unsigned long row_in, row_out, frequency_index;
+void STFT::extract(const T* fourier_spectra, size_t num_rows, T* power, T* phase, const unsigned char* active) const {
+    const size_t  last_complex = (transform_length_ - 1) / 2;
+    const double* weights      = power_weights_.data();
     T             real, imag;
-    T*            out_ptr         = (T*)vout_ptr;
-    T*            fourier_spectra = (T*)fourier_spectra_;
 
-    for (unsigned long window_index = 0; window_index < num_windows_; window_index++) {
-        row_in  = window_index * transform_length_;
-        row_out = window_index * num_frequencies_;
+    for (size_t window_index = 0; window_index < num_rows; window_index++) {
+        const T* row_in  = fourier_spectra + window_index * transform_length_;
+        const T* imag_in = row_in + transform_length_;
 
-        // Special case for freq=0 because FFTW doesn't give a complex value since its always zero
-        real             = fourier_spectra[row_in];
-        out_ptr[row_out] = real * real * scale_factor_;
+        // Segments skipped by the energy gate
+        if (active && !active[window_index]) {
+            if (power) {
+                std::fill_n(power + window_index * num_frequencies_, num_frequencies_, (T)gate_floor_);
+            }
+            if (phase) {
+                std::fill_n(phase + window_index * num_frequencies_, num_frequencies_, (T)0);
+            }
+            continue;
+        }
 
-        // Normal frequencies P=(i^2 + j^2) * 2*scale
-        for (frequency_index = 1; frequency_index < num_frequencies_ - 1; frequency_index++) {
-            real = fourier_spectra[row_in + frequency_index];
-            imag = fourier_spectra[row_in + (transform_length_ - frequency_index)];
+        // Constant-Q coefficients, interleaved
+        if (constant_q()) {
+            for (size_t bin = 0; bin < num_frequencies_; bin++) {
+                real = row_in[2 * bin];
+                imag = row_in[2 * bin + 1];
+                if (power) {
+                    power[window_index * num_frequencies_ + bin] = (real * real + imag * imag) * weights[bin];
+                }
+                if (phase) {
+                    phase[window_index * num_frequencies_ + bin] = atan2(imag, real);
+                }
+            }
+            continue;
+        }
 
-            out_ptr[row_out + frequency_index] = (real * real + imag * imag) * 2 * scale_factor_;
+        if (power) {
+            T* row_out = power + window_index * num_frequencies_;
+
+            real       = row_in[0];
+            row_out[0] = real * real * weights[0];
+
+            // Normal frequencies P=(i^2 + j^2) * 2*scale
+            for (size_t frequency_index = 1; frequency_index <= last_complex; frequency_index++) {
+                real                     = row_in[frequency_index];
+                imag                     = imag_in[-(ptrdiff_t)frequency_index];
+                row_out[frequency_index] = (real * real + imag * imag) * weights[frequency_index];
+            }
+
+            // Special case for Nyquist
+            if (transform_length_ % 2 == 0) {
+                real                      = row_in[last_complex + 1];
+                row_out[last_complex + 1] = real * real * weights[last_complex + 1];
+            }
         }
 
-        // Special case for Nyquist
-        real = fourier_spectra[row_in + frequency_index];
-        if (transform_length_ % 2 == 0) {
-            out_ptr[row_out + frequency_index] = real * real * scale_factor_;
-        } else {
-            imag                               = fourier_spectra[row_in + (transform_length_ - frequency_index)];
-            out_ptr[row_out + frequency_index] = (real * real + imag * imag) * 2 * scale_factor_;
+        if (phase) {
+            T* row_out = phase + window_index * num_frequencies_;
+
+            // DC and Nyquist are reported with zero phase
+            row_out[0] = 0;
+            for (size_t frequency_index = 1; frequency_index <= last_complex; frequency_index++) {
+                row_out[frequency_index] = atan2(imag_in[-(ptrdiff_t)frequency_index], row_in[frequency_index]);
+            }
+            if (transform_length_ % 2 == 0) {
+                row_out[last_complex + 1] = 0;
+            }
         }
     }
 }
+template void STFT::extract<float>(const float*, size_t, float*, float*, const unsigned char*) const;
+template void STFT::extract<double>(const double*, size_t, double*, double*, const unsigned char*) const;
+
+// Copy rows of a dense (time-major) output block through an output descriptor
+//
+// Rows are written a tile at a time so that frequency-major destinations are filled with runs of consecutive times
+template <typename T>
+void STFT::scatter(const T* dense, size_t first_row, size_t num_rows, const SpectrogramOutput& out) const {
+    T* out_ptr = (T*)out.data + (ptrdiff_t)first_row * out.time_stride;
+
+    for (size_t tile = 0; tile < num_rows; tile += kOutputTileRows) {
+        const size_t tile_rows = std::min(kOutputTileRows, num_rows - tile);
+
+        for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+            T*       column = out_ptr + (ptrdiff_t)frequency_index * out.freq_stride;
+            const T* in     = dense + tile * num_frequencies_ + frequency_index;
+
+            for (size_t row = tile; row < tile + tile_rows; row++) {
+                column[(ptrdiff_t)row * out.time_stride] = *in;
+                in += num_frequencies_;
+            }
+        }
+    }
+}
+template void STFT::scatter<float>(const float*, size_t, size_t, const SpectrogramOutput&) const;
+template void STFT::scatter<double>(const double*, size_t, size_t, const SpectrogramOutput&) const;
+
+// Bring the cached outputs up to date with the last execution, computing only what is stale
+template <typename T>
+void STFT::update_cache(bool want_power, bool want_phase) {
+    const bool   need_power = want_power && (power_cache_execution_ != execution_count_);
+    const bool   need_phase = want_phase && (phase_cache_execution_ != execution_count_);
+    const size_t num_bytes  = sizeof(T) * num_windows_ * num_frequencies_;
+
+    if (!need_power && !need_phase) {
+        return;
+    }
+
+    if (need_power) {
+        power_cache_.resize(num_bytes);
+        power_cache_execution_ = execution_count_;
+    }
+    if (need_phase) {
+        phase_cache_.resize(num_bytes);
+        phase_cache_execution_ = execution_count_;
+    }
+
+    get_power_phase<T>(*workspace_, need_power ? power_cache_.data() : NULL, need_phase ? phase_cache_.data() : NULL);
+}
+template void STFT::update_cache<float>(bool, bool);
+template void STFT::update_cache<double>(bool, bool);
+
+template <typename T>
+void STFT::get_power(void* vout_ptr) {
+    get_power_phase<T>(vout_ptr, NULL);
+}
 template void STFT::get_power<float>(void*);
 template void STFT::get_power<double>(void*);
 
 template <typename T>
 void STFT::get_phase(void* vout_ptr) {
-    unsigned long row_in, row_out, frequency_index;
-    T             real, imag;
-    T*            out_ptr         = (T*)vout_ptr;
-    T*            fourier_spectra = (T*)fourier_spectra_;
+    get_power_phase<T>(NULL, vout_ptr);
+}
+template void STFT::get_phase<float>(void*);
+template void STFT::get_phase<double>(void*);
+
+template <typename T>
+void STFT::get_power_phase(void* vpower_ptr, void* vphase_ptr) {
+    if (!cache_outputs_) {
+        get_power_phase<T>(*workspace_, vpower_ptr, vphase_ptr);
+        return;
+    }
+
+    update_cache<T>(vpower_ptr != NULL, vphase_ptr != NULL);
+    if (vpower_ptr) {
+        memcpy(vpower_ptr, power_cache_.data(), power_cache_.size());
+    }
+    if (vphase_ptr) {
+        memcpy(vphase_ptr, phase_cache_.data(), phase_cache_.size());
+    }
+}
+template void STFT::get_power_phase<float>(void*, void*);
+template void STFT::get_power_phase<double>(void*, void*);
 
-    for (unsigned long window_index = 0; window_index < num_windows_; window_index++) {
-        row_in  = window_index * transform_length_;
-        row_out = window_index * num_frequencies_;
+template <typename T>
+void STFT::get_power_phase(STFTWorkspace& workspace, void* vpower_ptr, void* vphase_ptr) const {
+    T* power_ptr = (T*)vpower_ptr;
+    T* phase_ptr = (T*)vphase_ptr;
+
+    for_each_block<T>(workspace, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+        const size_t offset = first_window * num_frequencies_;
+        extract<T>(fourier_spectra, num_rows, power_ptr ? power_ptr + offset : NULL,
+                   phase_ptr ? phase_ptr + offset : NULL, active_rows(workspace, first_window));
+    });
+}
+template void STFT::get_power_phase<float>(STFTWorkspace&, void*, void*) const;
+template void STFT::get_power_phase<double>(STFTWorkspace&, void*, void*) const;
 
-        // Special case for freq=0 because FFTW doesn't give a complex value since its always zero
-        out_ptr[row_out] = 0;
+template <typename T>
+void STFT::get_power_phase_strided(const SpectrogramOutput* power, const SpectrogramOutput* phase) {
+    const bool power_dense = !power || (power->freq_stride == 1 && power->time_stride == (ptrdiff_t)num_frequencies_);
+    const bool phase_dense = !phase || (phase->freq_stride == 1 && phase->time_stride == (ptrdiff_t)num_frequencies_);
 
-        // Normal frequencies P=(i^2 + j^2) * 2*scale
-        for (frequency_index = 1; frequency_index < num_frequencies_ - 1; frequency_index++) {
-            real = fourier_spectra[row_in + frequency_index];
-            imag = fourier_spectra[row_in + (transform_length_ - frequency_index)];
+    // Dense outputs need no staging
+    if (power_dense && phase_dense) {
+        get_power_phase<T>(power ? power->data : NULL, phase ? phase->data : NULL);
+        return;
+    }
 
-            out_ptr[row_out + frequency_index] = atan2(imag, real);
+    if (cache_outputs_) {
+        update_cache<T>(power != NULL, phase != NULL);
+        if (power) {
+            scatter<T>((const T*)power_cache_.data(), 0, num_windows_, *power);
         }
+        if (phase) {
+            scatter<T>((const T*)phase_cache_.data(), 0, num_windows_, *phase);
+        }
+        return;
+    }
 
-        // Special case for Nyquist
-        if (transform_length_ % 2 == 0) {
-            out_ptr[row_out + frequency_index] = 0;
-        } else {
-            real                               = fourier_spectra[row_in + frequency_index];
-            imag                               = fourier_spectra[row_in + (transform_length_ - frequency_index)];
-            out_ptr[row_out + frequency_index] = atan2(imag, real);
+    // Extract a tile of segments at a time into a small dense buffer, then scatter it
+    std::vector<T> power_tile(power ? kOutputTileRows * num_frequencies_ : 0);
+    std::vector<T> phase_tile(phase ? kOutputTileRows * num_frequencies_ : 0);
+
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_block_rows) {
+        for (size_t block_row = 0; block_row < num_block_rows; block_row += kOutputTileRows) {
+            const size_t num_rows  = std::min(kOutputTileRows, num_block_rows - block_row);
+            const size_t first_row = first_window + block_row;
+
+            extract<T>(fourier_spectra + block_row * transform_length_, num_rows, power ? power_tile.data() : NULL,
+                       phase ? phase_tile.data() : NULL, active_rows(*workspace_, first_row));
+            if (power) {
+                scatter<T>(power_tile.data(), first_row, num_rows, *power);
+            }
+            if (phase) {
+                scatter<T>(phase_tile.data(), first_row, num_rows, *phase);
+            }
         }
+    });
+}
+template void STFT::get_power_phase_strided<float>(const SpectrogramOutput*, const SpectrogramOutput*);
+template void STFT::get_power_phase_strided<double>(const SpectrogramOutput*, const SpectrogramOutput*);
+
+template <typename T>
+const T* STFT::power_view() {
+    update_cache<T>(true, false);
+    return (const T*)power_cache_.data();
+}
+template const float*  STFT::power_view();
+template const double* STFT::power_view();
+
+template <typename T>
+const T* STFT::phase_view() {
+    update_cache<T>(false, true);
+    return (const T*)phase_cache_.data();
+}
+template const float*  STFT::phase_view();
+template const double* STFT::phase_view();
+
+void STFT::get_frame_mask(unsigned char* mask) const {
+    if (gated()) {
+        memcpy(mask, workspace_->frame_active.data(), num_windows_);
+    } else {
+        memset(mask, 1, num_windows_);
+    }
+}
+
+template <typename T>
+void STFT::get_features(unsigned int features, void* vout_ptr) {
+    workspace_->previous_power.clear();
+    get_features<T>(*workspace_, features, vout_ptr);
+}
+template void STFT::get_features<float>(unsigned int, void*);
+template void STFT::get_features<double>(unsigned int, void*);
+
+// Compute the selected features of each segment from one row of power at a time
+template <typename T>
+void STFT::get_features(STFTWorkspace& workspace, unsigned int features, void* vout_ptr) const {
+    const unsigned int   all_features =
+        FEATURE_CENTROID | FEATURE_BANDWIDTH | FEATURE_FLUX | FEATURE_ROLLOFF | FEATURE_FLATNESS;
+    const double*        frequency = frequency_.data();
+    T*                   out_ptr   = (T*)vout_ptr;
+    std::vector<double>& previous  = workspace.previous_power;
+    std::vector<T>       power(num_frequencies_);
+
+    features &= all_features;
+    if (!features) {
+        return;
+    }
+
+    for_each_block<T>(workspace, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+        const unsigned char* active = active_rows(workspace, first_window);
+
+        for (size_t row = 0; row < num_rows; row++) {
+            extract<T>(fourier_spectra + row * transform_length_, 1, power.data(), NULL, active ? active + row : NULL);
+
+            // Moments of the power distribution over frequency
+            double total = 0.0, first_moment = 0.0, second_moment = 0.0, log_sum = 0.0, flux = 0.0;
+            for (size_t k = 0; k < num_frequencies_; k++) {
+                const double value = power[k];
+                total += value;
+                first_moment += value * frequency[k];
+                second_moment += value * frequency[k] * frequency[k];
+            }
+
+            // Logarithms cost more than the rest of the features, so only flatness takes them
+            if (features & FEATURE_FLATNESS) {
+                for (size_t k = 0; k < num_frequencies_; k++) {
+                    log_sum += log(std::max((double)power[k], DBL_MIN));
+                }
+            }
+
+            if (features & FEATURE_FLUX) {
+                if (previous.size() == num_frequencies_) {
+                    for (size_t k = 0; k < num_frequencies_; k++) {
+                        const double difference = power[k] - previous[k];
+                        flux += difference * difference;
+                    }
+                }
+                previous.assign(power.begin(), power.end());
+            }
+
+            const double centroid = (total > 0.0) ? first_moment / total : 0.0;
+            const double variance = (total > 0.0) ? second_moment / total - centroid * centroid : 0.0;
+            if (features & FEATURE_CENTROID) {
+                *out_ptr++ = centroid;
+            }
+            if (features & FEATURE_BANDWIDTH) {
+                *out_ptr++ = sqrt(std::max(variance, 0.0));
+            }
+            if (features & FEATURE_FLUX) {
+                *out_ptr++ = sqrt(flux);
+            }
+            if (features & FEATURE_ROLLOFF) {
+                const double target     = rolloff_fraction_ * total;
+                double       cumulative = 0.0;
+                size_t       k          = 0;
+                while (k + 1 < num_frequencies_ && cumulative + power[k] < target) {
+                    cumulative += power[k];
+                    k++;
+                }
+                *out_ptr++ = frequency[k];
+            }
+            if (features & FEATURE_FLATNESS) {
+                const double mean = total / num_frequencies_;
+                *out_ptr++        = (mean > 0.0) ? exp(log_sum / num_frequencies_) / mean : 0.0;
+            }
+        }
+    });
+}
+template void STFT::get_features<float>(STFTWorkspace&, unsigned int, void*) const;
+template void STFT::get_features<double>(STFTWorkspace&, unsigned int, void*) const;
+
+// Pick peaks from each segment's power, spreading groups of segments across threads. Each thread keeps its buffers
+// for all the groups it picks. Segments skipped by the energy gate have no peaks.
+template <typename T>
+void STFT::get_peaks(size_t K, size_t min_separation, void* vfreq_ptr, void* vpower_ptr) {
+    T* freq_ptr  = (T*)vfreq_ptr;
+    T* power_ptr = (T*)vpower_ptr;
+
+    if (K == 0) {
+        return;
+    }
+
+    const size_t                                   num_workers = std::max(num_threads_, 1);
+    std::vector<std::vector<T>>                    power(num_workers, std::vector<T>(kPeakRows * num_frequencies_));
+    std::vector<std::vector<unsigned char>>        is_peak(num_workers, std::vector<unsigned char>(num_frequencies_));
+    std::vector<std::vector<std::pair<T, size_t>>> candidates(num_workers);
+    std::vector<std::vector<size_t>>               accepted(num_workers);
+    for (size_t worker = 0; worker < num_workers; worker++) {
+        candidates[worker].reserve(num_frequencies_);
+        accepted[worker].reserve(K);
+    }
+
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+        const unsigned char* active     = active_rows(*workspace_, first_window);
+        const size_t         num_groups = (num_rows + kPeakRows - 1) / kPeakRows;
+
+        parallel_for_workers(num_groups, num_threads_, [&](size_t group, size_t worker) {
+            const size_t first_row   = group * kPeakRows;
+            const size_t group_rows  = std::min(kPeakRows, num_rows - first_row);
+            T*           group_power = power[worker].data();
+
+            extract<T>(fourier_spectra + first_row * transform_length_, group_rows, group_power, NULL,
+                       active ? active + first_row : NULL);
+
+            for (size_t row = 0; row < group_rows; row++) {
+                const size_t out_offset = (first_window + first_row + row) * K;
+                T*           freq_out   = freq_ptr ? freq_ptr + out_offset : NULL;
+                T*           power_out  = power_ptr ? power_ptr + out_offset : NULL;
+
+                // The gate floor is reported for the whole row, which would make a peak at DC
+                if (active && !active[first_row + row]) {
+                    if (freq_out) {
+                        std::fill_n(freq_out, K, (T)0);
+                    }
+                    if (power_out) {
+                        std::fill_n(power_out, K, (T)0);
+                    }
+                    continue;
+                }
+
+                pick_peaks<T>(group_power + row * num_frequencies_, K, min_separation, freq_out, power_out,
+                              is_peak[worker], candidates[worker], accepted[worker]);
+            }
+        });
+    });
+}
+template void STFT::get_peaks<float>(size_t, size_t, void*, void*);
+template void STFT::get_peaks<double>(size_t, size_t, void*, void*);
+
+// Pick the K strongest local maxima of one segment's power
+//
+// Local maxima are flagged by a branch-free pass over the row which compilers vectorize, so only the candidates are
+// ordered, by a heap from which peaks are taken strongest first until K are accepted
+template <typename T>
+void STFT::pick_peaks(const T* power, size_t K, size_t min_separation, T* freq_out, T* power_out,
+                      std::vector<unsigned char>& is_peak, std::vector<std::pair<T, size_t>>& candidates,
+                      std::vector<size_t>& accepted) const {
+    const size_t last            = num_frequencies_ - 1;
+    const double freq_resolution = sample_rate_ / transform_length_;
+
+    // Bins rising from the left and not rising to the right. The edges only have one neighbour, and a single bin has
+    // none.
+    if (num_frequencies_ >= 2) {
+        for (size_t k = 1; k < last; k++) {
+            is_peak[k] = (power[k] > power[k - 1]) & (power[k] >= power[k + 1]);
+        }
+        is_peak[0]    = (power[0] >= power[1]) && (power[0] > 0);
+        is_peak[last] = (power[last] > power[last - 1]);
+    } else if (num_frequencies_ == 1) {
+        is_peak[0] = (power[0] > 0);
+    }
+
+    candidates.clear();
+    for (size_t k = 0; k < num_frequencies_; k++) {
+        if (is_peak[k]) {
+            candidates.push_back(std::make_pair(power[k], num_frequencies_ - 1 - k));
+        }
+    }
+    std::make_heap(candidates.begin(), candidates.end());
+
+    // Strongest first; ties go to the lower frequency, which was stored with the larger complement
+    size_t num_peaks = 0;
+    accepted.clear();
+    while (num_peaks < K && !candidates.empty()) {
+        std::pop_heap(candidates.begin(), candidates.end());
+        const size_t k = last - candidates.back().second;
+        candidates.pop_back();
+
+        bool separated = true;
+        for (size_t other : accepted) {
+            separated &= (std::max(k, other) - std::min(k, other) >= min_separation);
+        }
+        if (!separated) {
+            continue;
+        }
+        accepted.push_back(k);
+
+        // Parabolic interpolation of the log power around the peak bin
+        double offset = 0.0;
+        double peak   = log(std::max((double)power[k], DBL_MIN));
+        if (k > 0 && k < last) {
+            const double left      = log(std::max((double)power[k - 1], DBL_MIN));
+            const double right     = log(std::max((double)power[k + 1], DBL_MIN));
+            const double curvature = left - 2.0 * peak + right;
+            if (curvature < 0.0) {
+                offset = 0.5 * (left - right) / curvature;
+                peak -= 0.25 * (left - right) * offset;
+            }
+        }
+
+        if (freq_out) {
+            freq_out[num_peaks] = constant_q() ? frequency_[k] * pow(2.0, offset / bins_per_octave_)
+                                               : (k + offset) * freq_resolution;
+        }
+        if (power_out) {
+            power_out[num_peaks] = exp(peak);
+        }
+        num_peaks++;
+    }
+
+    for (; num_peaks < K; num_peaks++) {
+        if (freq_out) {
+            freq_out[num_peaks] = 0;
+        }
+        if (power_out) {
+            power_out[num_peaks] = 0;
+        }
+    }
+}
+
+void STFT::set_colormap(const unsigned char* colormap) {
+    if (colormap) {
+        colormap_.assign(colormap, colormap + 4 * 256);
+    } else {
+        colormap_.clear();
     }
 }
-template void STFT::get_phase<float>(void*);
-template void STFT::get_phase<double>(void*);
 
+// Quantize the power of a tile of segments at a time, writing runs of consecutive segments of each frequency row
 template <typename T>
-std::vector<T> STFT::get_power_vector() {
-    std::vector<T> pwr;
-    pwr.resize(num_windows_ * num_frequencies_);
-    get_power<T>((void*)pwr.data());
-    return pwr;
+void STFT::get_image(double db_min, double db_max, ImageFormat format, void* vout_ptr) {
+    const unsigned int max_value = (format == IMAGE_GRAY16) ? 65535 : 255;
+    const float        db_scale  = (float)(10.0 * log10(2.0));
+    const float        offset    = (float)db_min;
+    const float        gain      = (db_max > db_min) ? (float)(max_value / (db_max - db_min)) : 0.0f;
+    const float        tiny      = FLT_MIN;
+
+    std::vector<unsigned char> grayscale;
+    if (format == IMAGE_RGBA8 && colormap_.empty()) {
+        grayscale.resize(4 * 256);
+        for (size_t level = 0; level < 256; level++) {
+            memset(&grayscale[4 * level], (int)level, 3);
+            grayscale[4 * level + 3] = 255;
+        }
+    }
+    const unsigned char* colormap = grayscale.empty() ? colormap_.data() : grayscale.data();
+
+    std::vector<T>     power(kOutputTileRows * num_frequencies_);
+    std::vector<float> levels(kOutputTileRows);
+
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_block_rows) {
+        const unsigned char* active = active_rows(*workspace_, first_window);
+
+        for (size_t block_row = 0; block_row < num_block_rows; block_row += kOutputTileRows) {
+            const size_t num_rows  = std::min(kOutputTileRows, num_block_rows - block_row);
+            const size_t first_row = first_window + block_row;
+
+            extract<T>(fourier_spectra + block_row * transform_length_, num_rows, power.data(), NULL,
+                       active ? active + block_row : NULL);
+
+            for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+                const size_t image_row = num_frequencies_ - 1 - frequency_index;
+                const size_t pixel     = image_row * num_windows_ + first_row;
+
+                for (size_t row = 0; row < num_rows; row++) {
+                    const float value = std::max((float)power[row * num_frequencies_ + frequency_index], tiny);
+                    const float level = (fast_log2(value) * db_scale - offset) * gain;
+                    levels[row]       = std::min(std::max(level, 0.0f), (float)max_value) + 0.5f;
+                }
+
+                if (format == IMAGE_GRAY8) {
+                    unsigned char* out_ptr = (unsigned char*)vout_ptr + pixel;
+                    for (size_t row = 0; row < num_rows; row++) {
+                        out_ptr[row] = (unsigned char)levels[row];
+                    }
+                } else if (format == IMAGE_GRAY16) {
+                    uint16_t* out_ptr = (uint16_t*)vout_ptr + pixel;
+                    for (size_t row = 0; row < num_rows; row++) {
+                        out_ptr[row] = (uint16_t)levels[row];
+                    }
+                } else if (format == IMAGE_RGBA8) {
+                    unsigned char* out_ptr = (unsigned char*)vout_ptr + 4 * pixel;
+                    for (size_t row = 0; row < num_rows; row++) {
+                        memcpy(out_ptr + 4 * row, colormap + 4 * (size_t)levels[row], 4);
+                    }
+                }
+            }
+        }
+    });
+}
+template void STFT::get_image<float>(double, double, ImageFormat, void*);
+template void STFT::get_image<double>(double, double, ImageFormat, void*);
+
+// Accumulate cross-spectra of channel pairs, a chunk of segments at a time
+//
+// Each channel's chunk is transformed once into its own buffer, then the auto-spectra of the channels and the
+// cross-spectra of the pairs are accumulated in double precision, each spread across threads
+template <typename T>
+void STFT::get_cross_spectra(const void* const* inputs, size_t num_channels, const SpectrogramChannelPair* pairs,
+                             size_t num_pairs, void* vcsd_ptr, void* vcoherence_ptr, void* vphase_ptr) const {
+    const size_t                      last_complex = (transform_length_ - 1) / 2;
+    std::vector<T*>                   buffers(num_channels);
+    std::vector<double>               auto_spectra(num_channels * num_frequencies_, 0.0);
+    std::vector<std::complex<double>> cross_spectra(num_pairs * num_frequencies_);
+
+    if (!half_complex("Cross-spectra")) {
+        return;
+    }
+
+    for (size_t pair = 0; pair < num_pairs; pair++) {
+        if (pairs[pair].first >= num_channels || pairs[pair].second >= num_channels) {
+            fprintf(stderr, "WARNING: Channel pair refers to a channel beyond the number of inputs. Ignoring pair.");
+        }
+    }
+
+    std::vector<STFTScratch> scratch;
+    init_scratch(scratch);
+
+    if (chunk_frames_ > 0) {
+        for (size_t channel = 0; channel < num_channels; channel++) {
+            buffers[channel] = (T*)fft_backend_->allocate(sizeof(T) * chunk_frames_ * transform_length_);
+        }
+    }
+
+    for (size_t first_window = 0; first_window < num_windows_; first_window += chunk_frames_) {
+        const size_t num_rows = std::min(chunk_frames_, num_windows_ - first_window);
+
+        parallel_for_workers(num_channels, num_threads_, [&](size_t channel, size_t worker) {
+            T*      block = buffers[channel];
+            double* auto_ = auto_spectra.data() + channel * num_frequencies_;
+
+            size_t   origin;
+            const T* samples = resample_rows<T>((const T*)inputs[channel], input_samples_, first_window, num_rows,
+                                                scratch[worker], origin);
+            segment<T>(samples, num_samples_, origin, first_window, num_rows, block, scratch[worker]);
+            execute_frames(block, num_rows, scratch[worker]);
+
+            for (size_t row = 0; row < num_rows; row++) {
+                const T* row_in = block + row * transform_length_;
+                for (size_t k = 0; k < num_frequencies_; k++) {
+                    const double imag = (k == 0 || k > last_complex) ? 0.0 : row_in[transform_length_ - k];
+                    auto_[k] += (double)row_in[k] * row_in[k] + imag * imag;
+                }
+            }
+        });
+
+        parallel_for(num_pairs, num_threads_, [&](size_t pair) {
+            if (pairs[pair].first >= num_channels || pairs[pair].second >= num_channels) {
+                return;
+            }
+
+            const T*              block_a = buffers[pairs[pair].first];
+            const T*              block_b = buffers[pairs[pair].second];
+            std::complex<double>* cross   = cross_spectra.data() + pair * num_frequencies_;
+
+            for (size_t row = 0; row < num_rows; row++) {
+                const T* row_a = block_a + row * transform_length_;
+                const T* row_b = block_b + row * transform_length_;
+
+                // X_a conj(X_b). DC and Nyquist are real.
+                cross[0] += (double)row_a[0] * row_b[0];
+                for (size_t k = 1; k <= last_complex; k++) {
+                    const double real_a = row_a[k], imag_a = row_a[transform_length_ - k];
+                    const double real_b = row_b[k], imag_b = row_b[transform_length_ - k];
+                    cross[k] += std::complex<double>(real_a * real_b + imag_a * imag_b,
+                                                     imag_a * real_b - real_a * imag_b);
+                }
+                if (transform_length_ % 2 == 0) {
+                    cross[last_complex + 1] += (double)row_a[last_complex + 1] * row_b[last_complex + 1];
+                }
+            }
+        });
+    }
+
+    for (size_t channel = 0; channel < num_channels; channel++) {
+        fft_backend_->release(buffers[channel]);
+    }
+
+    // Average and scale like the power, then form the outputs
+    T*           csd_ptr       = (T*)vcsd_ptr;
+    T*           coherence_ptr = (T*)vcoherence_ptr;
+    T*           phase_ptr     = (T*)vphase_ptr;
+    const double num_averaged  = (double)std::max(num_windows_, (size_t)1);
+
+    for (size_t pair = 0; pair < num_pairs; pair++) {
+        const bool   valid  = pairs[pair].first < num_channels && pairs[pair].second < num_channels;
+        const size_t first  = valid ? pairs[pair].first : 0;
+        const size_t second = valid ? pairs[pair].second : 0;
+
+        for (size_t k = 0; k < num_frequencies_; k++) {
+            const size_t               index  = pair * num_frequencies_ + k;
+            const double               scale  = valid ? power_weights_[k] / num_averaged : 0.0;
+            const std::complex<double> cross  = cross_spectra[index] * scale;
+            const double               auto_a = valid ? auto_spectra[first * num_frequencies_ + k] * scale : 0.0;
+            const double               auto_b = valid ? auto_spectra[second * num_frequencies_ + k] * scale : 0.0;
+
+            if (csd_ptr) {
+                csd_ptr[2 * index]     = cross.real();
+                csd_ptr[2 * index + 1] = cross.imag();
+            }
+            if (coherence_ptr) {
+                coherence_ptr[index] = (auto_a > 0.0 && auto_b > 0.0) ? std::norm(cross) / (auto_a * auto_b) : 0.0;
+            }
+            if (phase_ptr) {
+                phase_ptr[index] = std::arg(cross);
+            }
+        }
+    }
 }
-template std::vector<float>  STFT::get_power_vector();
-template std::vector<double> STFT::get_power_vector();
+template void STFT::get_cross_spectra<float>(const void* const*, size_t, const SpectrogramChannelPair*, size_t, void*,
+                                             void*, void*) const;
+template void STFT::get_cross_spectra<double>(const void* const*, size_t, const SpectrogramChannelPair*, size_t,
+                                              void*, void*, void*) const;
 
 template <typename T>
-std::vector<T> STFT::get_phase_vector() {
-    std::vector<T> phs;
-    phs.resize(num_windows_ * num_frequencies_);
-    get_phase<T>((void*)phs.data());
-    return phs;
+void STFT::get_batch_power_phase(void* vpower_ptr, void* vphase_ptr) const {
+    const T*     fourier_spectra = (const T*)batch_spectra_;
+    const size_t num_groups      = (batch_rows_ + kOutputTileRows - 1) / kOutputTileRows;
+
+    parallel_for(num_groups, num_threads_, [&](size_t group) {
+        const size_t first_row = group * kOutputTileRows;
+        const size_t num_rows  = std::min(kOutputTileRows, batch_rows_ - first_row);
+        T*           power_ptr = vpower_ptr ? (T*)vpower_ptr + first_row * num_frequencies_ : NULL;
+        T*           phase_ptr = vphase_ptr ? (T*)vphase_ptr + first_row * num_frequencies_ : NULL;
+
+        extract<T>(fourier_spectra + first_row * transform_length_, num_rows, power_ptr, phase_ptr, NULL);
+    });
 }
-template std::vector<float>  STFT::get_phase_vector();
-template std::vector<double> STFT::get_phase_vector();
+template void STFT::get_batch_power_phase<float>(void*, void*) const;
+template void STFT::get_batch_power_phase<double>(void*, void*) const;
 
 template <typename T>
 void STFT::get_power_periodogram(void* vout_ptr) {
-    unsigned long row_in;
-    T             real, imag;
-    T*            out_ptr         = (T*)vout_ptr;
-    T*            fourier_spectra = (T*)fourier_spectra_;
-    memset(out_ptr, 0, num_frequencies_ * data_size_);
+    const size_t last_complex = (transform_length_ - 1) / 2;
+
+    // Segments are summed in double over leaves of kSumRows segments fixed by their index, and the leaves are combined
+    // pairwise in a tree that only depends on the number of segments. The result is the same for any chunking and
+    // thread count.
+    std::vector<double>                                 carry(num_frequencies_, 0.0);
+    std::vector<std::vector<double>>                    sums;
+    std::vector<std::pair<size_t, std::vector<double>>> tree;
+
+    const auto push_leaf = [&](std::vector<double>& leaf) {
+        size_t level = 0;
+        while (!tree.empty() && tree.back().first == level) {
+            const std::vector<double>& left = tree.back().second;
+            for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+                leaf[frequency_index] = left[frequency_index] + leaf[frequency_index];
+            }
+            tree.pop_back();
+            level++;
+        }
+        tree.emplace_back(level, std::move(leaf));
+    };
+
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+        const unsigned char* active       = active_rows(*workspace_, first_window);
+        const size_t         head_rows    = std::min(num_rows, kSumRows - first_window % kSumRows);
+        const size_t         num_segments = 1 + (num_rows - head_rows + kSumRows - 1) / kSumRows;
+        sums.resize(num_segments);
+
+        // The first segment continues the leaf carried over from the previous block
+        parallel_for(num_segments, num_threads_, [&](size_t segment) {
+            const size_t         begin = (segment == 0) ? 0 : head_rows + (segment - 1) * kSumRows;
+            const size_t         end   = std::min(num_rows, head_rows + segment * kSumRows);
+            std::vector<double>& sum   = sums[segment];
+            if (segment == 0) {
+                sum = carry;
+            } else {
+                sum.assign(num_frequencies_, 0.0);
+            }
+
+            for (size_t window_index = begin; window_index < end; window_index++) {
+                const T* row_in  = fourier_spectra + window_index * transform_length_;
+                const T* imag_in = row_in + transform_length_;
+
+                // Segments skipped by the energy gate add no power
+                if (active && !active[window_index]) {
+                    continue;
+                }
+
+                // Constant-Q coefficients, interleaved
+                if (constant_q()) {
+                    for (size_t bin = 0; bin < num_frequencies_; bin++) {
+                        const double real = row_in[2 * bin];
+                        const double imag = row_in[2 * bin + 1];
+
+                        sum[bin] += real * real + imag * imag;
+                    }
+                    continue;
+                }
 
-    for (unsigned long window_index = 0; window_index < num_windows_; window_index++) {
-        row_in = window_index * transform_length_;
+                // Special case for freq=0 because FFTW doesn't give a complex value since its always zero
+                sum[0] += (double)row_in[0] * row_in[0];
 
-        // Special case for freq=0 because FFTW doesn't give a complex value since its always zero
-        real = fourier_spectra[row_in];
-        out_ptr[0] += real * real * scale_factor_;
+                // Normal frequencies P=(i^2 + j^2)
+                for (size_t frequency_index = 1; frequency_index <= last_complex; frequency_index++) {
+                    const double real = row_in[frequency_index];
+                    const double imag = imag_in[-(ptrdiff_t)frequency_index];
 
-        // Normal frequencies P=(i^2 + j^2) * 2*scale
-        for (unsigned long frequency_index = 1; frequency_index < num_frequencies_ - 1; frequency_index++) {
-            real = fourier_spectra[row_in + frequency_index];
-            imag = fourier_spectra[row_in + (transform_length_ - frequency_index)];
+                    sum[frequency_index] += real * real + imag * imag;
+                }
 
-            out_ptr[frequency_index] += (real * real + imag * imag) * 2 * scale_factor_;
+                // Special case for Nyquist
+                if (transform_length_ % 2 == 0) {
+                    sum[last_complex + 1] += (double)row_in[last_complex + 1] * row_in[last_complex + 1];
+                }
+            }
+        });
+
+        // Completed leaves go up the tree in order, a partial one is carried into the next block
+        for (size_t segment = 0; segment < num_segments; segment++) {
+            const size_t end = std::min(num_rows, head_rows + segment * kSumRows);
+            if ((first_window + end) % kSumRows == 0) {
+                push_leaf(sums[segment]);
+                carry.assign(num_frequencies_, 0.0);
+            } else {
+                carry.swap(sums[segment]);
+            }
         }
+    });
 
-        // Special case for Nyquist
-        real = fourier_spectra[row_in + num_frequencies_ - 1];
-        if (num_frequencies_ % 2 == 0) {
-            out_ptr[num_frequencies_ - 1] += real * real * scale_factor_;
-        } else {
-            out_ptr[num_frequencies_ - 1] += real * real * 2 * scale_factor_;
+    if (num_windows_ % kSumRows != 0) {
+        push_leaf(carry);
+    }
+
+    // Fold the remaining subtrees from the smallest up and scale like the power
+    std::vector<double> total(num_frequencies_, 0.0);
+    for (size_t subtree = tree.size(); subtree > 0; subtree--) {
+        const std::vector<double>& left = tree[subtree - 1].second;
+        for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+            total[frequency_index] = left[frequency_index] + total[frequency_index];
         }
     }
+
+    T* out_ptr = (T*)vout_ptr;
+    for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+        out_ptr[frequency_index] = (T)(total[frequency_index] * power_weights_[frequency_index]);
+    }
 }
 template void STFT::get_power_periodogram<float>(void*);
 template void STFT::get_power_periodogram<double>(void*);
 
+template <typename T>
+void STFT::get_percentile_periodogram(double percentile, void* vout_ptr) {
+    T* out_ptr = (T*)vout_ptr;
+    memset(out_ptr, 0, num_frequencies_ * data_size_);
+
+    if (percentile < 0.0 || percentile > 100.0) {
+        fprintf(stderr, "WARNING: Percentile must be between 0 and 100. Clamping.");
+        percentile = std::min(std::max(percentile, 0.0), 100.0);
+    }
+
+    // Segments skipped by the energy gate are left out of the distribution
+    size_t num_active = num_windows_;
+    if (gated()) {
+        num_active = (size_t)std::count(workspace_->frame_active.begin(), workspace_->frame_active.end(), 1);
+    }
+    if (num_active == 0) {
+        return;
+    }
+
+    // Bin columns are gathered a group at a time, bounded by kChunkBytes, or by a chunk of spectra when tiled chunks are
+    // larger. Untiled spectra are read once per group; tiled transforms recompute the segments once per group.
+    const size_t last_complex = (transform_length_ - 1) / 2;
+    const size_t chunk_bytes  = tiled_ ? chunk_frames_ * transform_length_ * sizeof(T) : 0;
+    const size_t group_bytes  = std::max(chunk_bytes, kChunkBytes);
+    const size_t group_bins   = std::max((size_t)1, group_bytes / sizeof(T) / num_active);
+    std::vector<T> columns(std::min(group_bins, num_frequencies_) * num_active);
+
+    for (size_t first_bin = 0; first_bin < num_frequencies_; first_bin += group_bins) {
+        const size_t num_bins = std::min(group_bins, num_frequencies_ - first_bin);
+        size_t       column   = 0;
+
+        // Blocked transpose: a few bins of a run of segments at a time keeps both sides in cache
+        for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+            const unsigned char* active = active_rows(*workspace_, first_window);
+
+            for (size_t tile = 0; tile < num_bins; tile += kTransposeBins) {
+                const size_t tile_end = std::min(tile + kTransposeBins, num_bins);
+                size_t       row_out  = column;
+
+                for (size_t window_index = 0; window_index < num_rows; window_index++) {
+                    if (active && !active[window_index]) {
+                        continue;
+                    }
+
+                    const T* row_in = fourier_spectra + window_index * transform_length_;
+                    for (size_t bin = tile; bin < tile_end; bin++) {
+                        const size_t frequency_index = first_bin + bin;
+                        const bool   is_complex      = frequency_index > 0 && frequency_index <= last_complex;
+                        T            real, imag;
+                        if (constant_q()) {
+                            real = row_in[2 * frequency_index];
+                            imag = row_in[2 * frequency_index + 1];
+                        } else {
+                            real = row_in[frequency_index];
+                            imag = is_complex ? row_in[transform_length_ - frequency_index] : 0;
+                        }
+
+                        columns[bin * num_active + row_out] =
+                            (real * real + imag * imag) * power_weights_[frequency_index];
+                    }
+                    row_out++;
+                }
+            }
+
+            column += active ? (size_t)std::count(active, active + num_rows, 1) : num_rows;
+        });
+
+        // Select the order statistics of each bin, interpolating linearly between neighbouring ranks
+        const double position = percentile / 100.0 * (double)(num_active - 1);
+        const size_t rank     = (size_t)position;
+        const double fraction = position - (double)rank;
+
+        parallel_for(num_bins, num_threads_, [&](size_t bin) {
+            T* first = columns.data() + bin * num_active;
+            T* last  = first + num_active;
+
+            std::nth_element(first, first + rank, last);
+            T value = first[rank];
+            if (fraction > 0.0) {
+                value += (T)(fraction * (double)(*std::min_element(first + rank + 1, last) - value));
+            }
+            out_ptr[first_bin + bin] = value;
+        });
+    }
+}
+template void STFT::get_percentile_periodogram<float>(double, void*);
+template void STFT::get_percentile_periodogram<double>(double, void*);
+
 template <typename T>
 void STFT::get_phase_periodogram(void* vout_ptr) {
-    unsigned long row_in;
-    T             real, imag;
-    T*            out_ptr         = (T*)vout_ptr;
-    T*            fourier_spectra = (T*)fourier_spectra_;
+    T* out_ptr = (T*)vout_ptr;
     memset(out_ptr, 0, num_frequencies_ * data_size_);
 
-    for (unsigned long window_index = 0; window_index < num_windows_; window_index++) {
-        row_in = window_index * transform_length_;
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t, size_t num_rows) {
+        size_t row_in;
+        T      real, imag;
+
+        for (size_t window_index = 0; window_index < num_rows; window_index++) {
+            row_in = window_index * transform_length_;
+
+            // Constant-Q coefficients, interleaved
+            if (constant_q()) {
+                for (size_t bin = 0; bin < num_frequencies_; bin++) {
+                    out_ptr[bin] = atan2(fourier_spectra[row_in + 2 * bin + 1], fourier_spectra[row_in + 2 * bin]);
+                }
+                continue;
+            }
 
-        // Normal frequencies P=(i^2 + j^2) * 2*scale
-        for (unsigned long frequency_index = 1; frequency_index < num_frequencies_ - 1; frequency_index++) {
-            real = fourier_spectra[row_in + frequency_index];
-            imag = fourier_spectra[row_in + (transform_length_ - frequency_index)];
+            // Normal frequencies P=(i^2 + j^2) * 2*scale
+            for (size_t frequency_index = 1; frequency_index < num_frequencies_ - 1; frequency_index++) {
+                real = fourier_spectra[row_in + frequency_index];
+                imag = fourier_spectra[row_in + (transform_length_ - frequency_index)];
 
-            out_ptr[frequency_index] = atan2(imag, real);
+                out_ptr[frequency_index] = atan2(imag, real);
+            }
         }
-    }
+    });
 }
 template void STFT::get_phase_periodogram<float>(void*);
 template void STFT::get_phase_periodogram<double>(void*);
+
+// Inverse transform a function of each segment's power spectrum: the log magnitude for the real cepstrum, or the power
+// itself for the autocorrelation. The function is applied in the pass unpacking a chunk of spectra into the inverse
+// input, then the whole chunk is transformed with one batched half-complex to real plan. Both results are even, so
+// the first num_frequencies_ values of each segment are kept. Chunks are unpacked into the thread's inverse block.
+//
+// Segments skipped by the energy gate have no spectrum to invert, and their rows are zero.
+template <typename T>
+void STFT::inverse_power(bool log_magnitude, void* vout_ptr) {
+    T*           out_ptr      = (T*)vout_ptr;
+    const size_t last_complex = (transform_length_ - 1) / 2;
+    const T      min_power    = std::numeric_limits<T>::min();
+    const T      scale        = (T)1.0 / transform_length_;
+
+    if (!half_complex(log_magnitude ? "Cepstrum" : "Autocorrelation")) {
+        return;
+    }
+
+    init_inverse_fft();
+
+    for_each_block<T>(*workspace_, [&](const T* fourier_spectra, size_t first_window, size_t num_rows) {
+        const size_t num_chunks = (num_rows + chunk_frames_ - 1) / chunk_frames_;
+
+        parallel_for_workers(num_chunks, num_threads_, [&](size_t chunk, size_t worker) {
+            const size_t         first_row  = chunk * chunk_frames_;
+            const size_t         chunk_rows = std::min(chunk_frames_, num_rows - first_row);
+            const unsigned char* active =
+                gated() ? workspace_->frame_active.data() + first_window + first_row : NULL;
+            T* block = (T*)inverse_blocks_[worker];
+
+            for (size_t row = 0; row < chunk_rows; row++) {
+                const T* spectrum = fourier_spectra + (first_row + row) * transform_length_;
+                T*       inverse  = block + row * transform_length_;
+                if (active && !active[row]) {
+                    std::fill(inverse, inverse + transform_length_, (T)0.0);
+                    continue;
+                }
+
+                for (size_t frequency_index = 0; frequency_index < num_frequencies_; frequency_index++) {
+                    const T real  = spectrum[frequency_index];
+                    const T imag  = (frequency_index > 0 && frequency_index <= last_complex)
+                                        ? spectrum[transform_length_ - frequency_index]
+                                        : (T)0.0;
+                    const T power = real * real + imag * imag;
+
+                    inverse[frequency_index] = log_magnitude ? (T)0.5 * std::log(std::max(power, min_power)) : power;
+                }
+                std::fill(inverse + num_frequencies_, inverse + transform_length_, (T)0.0);
+            }
+
+            execute_inverse(block, chunk_rows, workspace_->scratch[worker]);
+
+            for (size_t row = 0; row < chunk_rows; row++) {
+                const T* inverse = block + row * transform_length_;
+                T*       out     = out_ptr + (first_window + first_row + row) * num_frequencies_;
+                for (size_t index = 0; index < num_frequencies_; index++) {
+                    out[index] = inverse[index] * scale;
+                }
+            }
+        });
+    });
+}
+template void STFT::inverse_power<float>(bool, void*);
+template void STFT::inverse_power<double>(bool, void*);
@@ -1,48 +1,134 @@
 #ifndef STFT_H
 #define STFT_H
 
-#include <fftw3.h>
+#include <atomic>
+#include <complex>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "constant_q.h"
+#include "fft_backend.h"
+#include "resampler.h"
 #include "spectrogram.h"
+#include "tuning.h"
+
+// Scratch of one thread executing into a workspace, sized up front so that executions allocate nothing
+struct STFTScratch {
+    std::vector<double>        prefix;
+    std::vector<double>        emphasized;
+    std::vector<double>        sums;
+    std::vector<double>        moments;
+    std::vector<double>        constant_q;
+    std::vector<unsigned char> fft;
+    std::vector<unsigned char> resampled;
+    Resampler::State           resampler;
+};
+
+// Buffers written while executing a transform. Each transform owns one; concurrent callers supply their own.
+struct STFTWorkspace {
+    STFTWorkspace() : signal(NULL), fourier_spectra(NULL), frame_buffer(NULL) {}
+
+    const void*                       signal;
+    void*                             fourier_spectra;
+    void*                             frame_buffer;
+    std::vector<double>               anchor_spectra;
+    std::vector<std::complex<double>> sdft_state;
+    std::vector<unsigned char>        frame_active;
+    std::vector<double>               previous_power;
+    std::vector<unsigned char>        resampled_signal;
+    std::vector<STFTScratch>          scratch;
+};
+
+// State of a real-time stream, all allocated up front so that pushing samples never allocates, locks or makes system
+// calls. Completed segments pass from the producer to a single consumer through a ring of power rows: the producer
+// only advances `written` and the consumer only advances `read`, each on its own cache line.
+struct STFTRealtime {
+    STFTRealtime()
+        : frame_buffer(NULL), num_pending(0), num_frames(0), queue_length(0), dropped(0), written(0), read(0) {}
+
+    // Producer: the samples of the segment being filled, and the buffers to transform it
+    std::unique_ptr<FFTPlan<double>> fft_plan;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan;
+    void*                            frame_buffer;
+    std::vector<unsigned char>       scratch;
+    std::vector<unsigned char>       pending;
+    size_t                           num_pending;
+    size_t                           num_frames;
+
+    // Queue of power rows, with the index of the segment each one came from
+    size_t                     queue_length;
+    std::vector<unsigned char> queue;
+    std::vector<size_t>        queue_frames;
+    std::atomic<size_t>        dropped;
+    char                       written_padding[64];
+    std::atomic<size_t>        written;
+    char                       read_padding[64];
+    std::atomic<size_t>        read;
+};
 
 class STFT {
    public:
     // Setup
     STFT(const SpectrogramInput& input, const SpectrogramConfig& config);
-    STFT(const STFT& orig);
+    STFT(const STFT& orig) = delete;
+    STFT& operator=(const STFT& orig) = delete;
     virtual ~STFT();
+    static size_t estimate_memory(const SpectrogramInput& input, const SpectrogramConfig& config);
 
     // Input accessors
-    unsigned long num_samples() const { return num_samples_; };
-    double        sample_rate() const { return sample_rate_; };
-    int           data_size() const { return data_size_; };
-    PaddingMode   padding_mode() const { return padding_mode_; };
-    WindowType    window_type() const { return window_type_; };
-    unsigned long window_length() const { return window_length_; };
-    unsigned long window_overlap() const { return window_overlap_; };
+    size_t         num_samples() const { return num_samples_; };
+    double         sample_rate() const { return sample_rate_; };
+    int            data_size() const { return data_size_; };
+    PaddingMode    padding_mode() const { return padding_mode_; };
+    WindowType     window_type() const { return window_type_; };
+    size_t         window_length() const { return window_length_; };
+    size_t         window_overlap() const { return window_overlap_; };
+    size_t         transform_length() const { return transform_length_; };
+    ExecutionMode  execution_mode() const { return execution_mode_; };
+    PlannerRigor   planner_rigor() const { return planner_rigor_; };
+    int            num_threads() const { return num_threads_; };
+    bool           constant_q() const { return bins_per_octave_ > 0; };
+    FFTBackendType fft_backend() const { return fft_backend_->type(); };
 
     // Derived accessors
-    unsigned long       num_windows() const { return num_windows_; };
-    unsigned long       num_frequencies() const { return num_frequencies_; };
-    std::vector<double> window_coefs() const { return window_coefs_; };
+    size_t                     num_windows() const { return num_windows_; };
+    size_t                     num_frequencies() const { return num_frequencies_; };
+    const std::vector<double>& window_coefs() const { return window_coefs_; };
+    const void*                fourier_spectra() const { return tiled_ ? NULL : workspace_->fourier_spectra; };
+    bool                       tiled() const { return tiled_; };
+    size_t                     chunk_frames() const { return chunk_frames_; };
+    size_t                     memory_bytes() const;
 
     // Computation
-    void compute(void*);
+    void           compute(void*);
+    void           compute(const void* signal, STFTWorkspace& workspace) const;
+    STFTWorkspace* create_workspace() const;
+    void           init_scratch(std::vector<STFTScratch>& scratch) const;
+    size_t         fft_scratch_size() const;
+    void           destroy_workspace(STFTWorkspace* workspace) const;
+    size_t         compute_batch(const SpectrogramClip* clips, size_t num_clips, size_t* offsets);
 
-    // Outputs
+    // Real-time streams
+    STFTRealtime* create_realtime(size_t queue_length) const;
+    void          destroy_realtime(STFTRealtime* realtime) const;
     template <typename T>
-    std::vector<T> get_time_vector() const {
-        return time_;
-    }
+    size_t push_realtime(STFTRealtime& realtime, const T* samples, size_t num_samples) const;
     template <typename T>
-    std::vector<T> get_frequency_vector() const {
-        return frequency_;
-    }
-    template <typename T>
-    std::vector<T> get_power_vector();
+    bool pop_realtime(STFTRealtime& realtime, T* power, size_t* frame) const;
+
+    // Range queries
+    void   bind(const void* signal);
+    size_t range_windows(double start_time, double end_time, size_t* first_window) const;
     template <typename T>
-    std::vector<T> get_phase_vector();
+    void get_power_range(double start_time, double end_time, void* out_ptr);
+
+    // Outputs
+    const std::vector<double>& time_vector() const { return time_; }
+    const std::vector<double>& frequency_vector() const { return frequency_; }
 
     template <typename T>
     void get_time(void* out_ptr);
@@ -53,42 +139,224 @@ class STFT {
     template <typename T>
     void get_phase(void* out_ptr);
     template <typename T>
+    void get_power_phase(void* power_ptr, void* phase_ptr);
+    template <typename T>
+    void get_power_phase(STFTWorkspace& workspace, void* power_ptr, void* phase_ptr) const;
+    template <typename T>
+    void get_power_phase_strided(const SpectrogramOutput* power, const SpectrogramOutput* phase);
+    template <typename T>
+    const T* power_view();
+    template <typename T>
+    const T* phase_view();
+    void get_frame_mask(unsigned char* mask) const;
+    template <typename T>
+    void get_features(unsigned int features, void* out_ptr);
+    template <typename T>
+    void get_features(STFTWorkspace& workspace, unsigned int features, void* out_ptr) const;
+    template <typename T>
+    void get_peaks(size_t K, size_t min_separation, void* freq_ptr, void* power_ptr);
+    template <typename T>
+    void get_image(double db_min, double db_max, ImageFormat format, void* out_ptr);
+    void set_colormap(const unsigned char* colormap);
+    template <typename T>
+    void get_cross_spectra(const void* const* inputs, size_t num_channels, const SpectrogramChannelPair* pairs,
+                           size_t num_pairs, void* csd_ptr, void* coherence_ptr, void* phase_ptr) const;
+    template <typename T>
+    void get_batch_power_phase(void* power_ptr, void* phase_ptr) const;
+    template <typename T>
     void get_power_periodogram(void* out_ptr);
     template <typename T>
+    void get_percentile_periodogram(double percentile, void* out_ptr);
+    template <typename T>
     void get_phase_periodogram(void* out_ptr);
+    template <typename T>
+    void get_cepstrum(void* out_ptr) {
+        inverse_power<T>(true, out_ptr);
+    }
+    template <typename T>
+    void get_autocorrelation(void* out_ptr) {
+        inverse_power<T>(false, out_ptr);
+    }
 
    private:
+    // Empty transform, only used to derive sizes
+    STFT();
+    void configure(const SpectrogramInput& input, const SpectrogramConfig& config);
+
     // Input validation
     void validate();
 
     // Calculate derived parameters
-    void calc_num_windows();
+    void   calc_num_windows();
+    size_t count_windows(size_t num_samples) const;
     void calc_num_frequencies();
+    void configure_constant_q();
+    void calc_chunking();
+    void apply_tuning();
+
+    // Tuning database entry shared with similar configurations
+    TuningKey tuning_key() const;
 
     // Initialize
+    void select_execution_mode();
     void init_window_coefs();
     void init_fft();
+    void init_sliding_dft();
     void init_time();
     void init_frequency();
 
+    // Outputs which read the half-complex spectra directly, warning when they are unavailable
+    bool half_complex(const char* output) const;
+
+    // Resampling
+    size_t resampled_samples(size_t input_samples) const {
+        return resampler_ ? resampler_->output_length(input_samples) : input_samples;
+    }
+    const void* resample(const void* signal, size_t num_samples, std::vector<unsigned char>& buffer) const;
+    template <typename T>
+    const T* resample_rows(const T* signal, size_t input_samples, size_t first_window, size_t num_rows,
+                           STFTScratch& scratch, size_t& origin) const;
+    void     reset_resampler(std::vector<STFTScratch>& scratch) const;
+
+    // Output extraction
+    template <typename T>
+    void extract(const T* fourier_spectra, size_t num_rows, T* power, T* phase, const unsigned char* active) const;
+    const unsigned char* active_rows(const STFTWorkspace& workspace, size_t first_window) const {
+        return gated() ? workspace.frame_active.data() + first_window : NULL;
+    };
+    template <typename T>
+    void scatter(const T* dense, size_t first_row, size_t num_rows, const SpectrogramOutput& out) const;
+    template <typename T>
+    void update_cache(bool want_power, bool want_phase);
+    template <typename T>
+    const T* power_tile(size_t tile);
+    template <typename T>
+    void inverse_power(bool log_magnitude, void* out_ptr);
+    template <typename T>
+    void pick_peaks(const T* power, size_t K, size_t min_separation, T* freq_out, T* power_out,
+                    std::vector<unsigned char>& is_peak, std::vector<std::pair<T, size_t>>& candidates,
+                    std::vector<size_t>& accepted) const;
+
+    // Computation
+    template <typename T>
+    std::unique_ptr<FFTPlan<T>> plan_frames(size_t num_frames, T* buffer, bool unaligned = false,
+                                            FFTKind kind = FFT_FORWARD) const {
+        const FFTBackend::PlanConfig plan_config = {transform_length_, num_frames, kind, planner_rigor_, unaligned};
+        return fft_backend_->plan(plan_config, buffer);
+    }
+    void init_inverse_fft();
+    template <typename T>
+    void segment(const T* signal, size_t num_samples, size_t origin, size_t first_window, size_t num_rows, T* block,
+                 STFTScratch& scratch, const unsigned char* active = NULL) const;
+    template <typename T>
+    void segment_preprocessed(const T* signal, size_t num_samples, size_t origin, size_t first_window,
+                              size_t num_rows, T* block, STFTScratch& scratch, const unsigned char* active) const;
+    template <typename T>
+    void transform_block(const T* signal, size_t first_window, size_t num_rows, T* block, unsigned char* active,
+                         STFTScratch& scratch) const;
+    template <typename T>
+    void compute_fft(const T* signal, STFTWorkspace& workspace) const;
+    void init_batch(size_t num_rows);
+    template <typename T>
+    void compute_batch(const SpectrogramClip* clips, size_t num_clips, const std::vector<size_t>& first_rows);
+    void execute_batch(float* block, STFTScratch& scratch) const {
+        fftf_plan_batch_->execute_with_scratch(block, (float*)scratch.fft.data());
+    };
+    void execute_batch(double* block, STFTScratch& scratch) const {
+        fft_plan_batch_->execute_with_scratch(block, (double*)scratch.fft.data());
+    };
+    template <typename T, typename Visitor>
+    void for_each_block(STFTWorkspace& workspace, Visitor visit) const;
+    void execute_frames(float* block, size_t num_rows, STFTScratch& scratch) const {
+        ((num_rows == chunk_frames_) ? fftf_plan_ : fftf_plan_tail_)
+            ->execute_with_scratch(block, (float*)scratch.fft.data());
+    };
+    void execute_frames(double* block, size_t num_rows, STFTScratch& scratch) const {
+        ((num_rows == chunk_frames_) ? fft_plan_ : fft_plan_tail_)
+            ->execute_with_scratch(block, (double*)scratch.fft.data());
+    };
+    template <typename T>
+    void apply_constant_q(T* block, size_t num_rows, STFTScratch& scratch) const {
+        if (constant_q_kernel_) {
+            constant_q_kernel_->apply<T>(block, num_rows, scratch.constant_q.data());
+        }
+    }
+    void execute_inverse(float* block, size_t num_rows, STFTScratch& scratch) const {
+        ((num_rows == chunk_frames_) ? fftf_plan_inverse_ : fftf_plan_inverse_tail_)
+            ->execute_with_scratch(block, (float*)scratch.fft.data());
+    };
+    void execute_inverse(double* block, size_t num_rows, STFTScratch& scratch) const {
+        ((num_rows == chunk_frames_) ? fft_plan_inverse_ : fft_plan_inverse_tail_)
+            ->execute_with_scratch(block, (double*)scratch.fft.data());
+    };
+
+    // Sliding DFT
+    template <typename T>
+    void compute_sliding_dft(const T* signal, STFTWorkspace& workspace) const;
+    template <typename T>
+    void anchor_sliding_dft(const T* signal, size_t start, STFTWorkspace& workspace) const;
+    void execute_single(float* buffer, STFTScratch& scratch) const {
+        fftf_plan_single_->execute_with_scratch(buffer, (float*)scratch.fft.data());
+    };
+    void execute_single(double* buffer, STFTScratch& scratch) const {
+        fft_plan_single_->execute_with_scratch(buffer, (double*)scratch.fft.data());
+    };
+
+    // Real-time streams
+    template <typename T>
+    void transform_realtime(STFTRealtime& realtime, const T* samples) const;
+    void execute_realtime(STFTRealtime& realtime, float* frame) const {
+        realtime.fftf_plan->execute_with_scratch(frame, (float*)realtime.scratch.data());
+    };
+    void execute_realtime(STFTRealtime& realtime, double* frame) const {
+        realtime.fft_plan->execute_with_scratch(frame, (double*)realtime.scratch.data());
+    };
+
     // User-supplied input parameters
-    double        sample_rate_;
-    unsigned long num_samples_;
-    int           data_size_;
-    int           stride_;
+    double sample_rate_;
+    size_t num_samples_;
+    int    data_size_;
+    size_t stride_;
 
     // User-supplied transform parameters
     PaddingMode   padding_mode_;
     WindowType    window_type_;
-    unsigned long window_length_;
-    unsigned long window_overlap_;
-    unsigned long transform_length_;
+    size_t        window_length_;
+    size_t        window_overlap_;
+    size_t        transform_length_;
+    ExecutionMode execution_mode_;
+    bool          cache_outputs_;
+    size_t        max_memory_bytes_;
+    double        gate_threshold_;
+    double        gate_floor_;
+    double        rolloff_fraction_;
+    DetrendMode   detrend_;
+    double        pre_emphasis_;
+    PlannerRigor  planner_rigor_;
+    size_t        chunk_override_;
+    int           num_threads_;
+    std::string   tuning_file_;
+    bool          tuned_;
+
+    // Resampling in front of segmentation. The parameters above then describe the resampled signal.
+    std::unique_ptr<Resampler> resampler_;
+    size_t                     input_samples_;
+    size_t                     input_stride_;
+
+    // Constant-Q transform of each segment's spectrum, replacing its linear bins
+    size_t                                 bins_per_octave_;
+    double                                 min_frequency_;
+    double                                 max_frequency_;
+    std::shared_ptr<const ConstantQKernel> constant_q_kernel_;
 
     // Derived parameters
-    unsigned long       num_windows_;
-    unsigned long       num_frequencies_;
+    size_t              num_windows_;
+    size_t              num_frequencies_;
     std::vector<double> window_coefs_;
     double              scale_factor_;
+    std::vector<double> power_weights_;
+    bool                gated() const { return gate_threshold_ > 0.0; }
+    bool                preprocessed() const { return detrend_ != DETREND_NONE || pre_emphasis_ != 0.0; }
     bool                isFloat() const { return (data_size_ == sizeof(float)); }
     bool                isDouble() const { return (data_size_ == sizeof(double)); }
 
@@ -96,10 +364,63 @@ class STFT {
     std::vector<double> time_;
     std::vector<double> frequency_;
 
-    // FFT-related
-    fftw_plan  fftw_plan_;
-    fftwf_plan fftwf_plan_;
-    void*      fourier_spectra_;
+    // Output cache, tagged with the execution it was computed from
+    size_t                     execution_count_;
+    size_t                     power_cache_execution_;
+    size_t                     phase_cache_execution_;
+    std::vector<unsigned char> power_cache_;
+    std::vector<unsigned char> phase_cache_;
+
+    // FFT-related. Plans of the precision of the data are created, on buffers from the backend.
+    const FFTBackend*                fft_backend_;
+    bool                             tiled_;
+    size_t                           chunk_frames_;
+    size_t                           tail_frames_;
+    std::unique_ptr<FFTPlan<double>> fft_plan_;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan_;
+    std::unique_ptr<FFTPlan<double>> fft_plan_tail_;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan_tail_;
+    STFTWorkspace*                   workspace_;
+
+    // Half-complex to real plans for cepstra and autocorrelations and a chunk of inverse input per thread, created on
+    // first use
+    std::unique_ptr<FFTPlan<double>> fft_plan_inverse_;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan_inverse_;
+    std::unique_ptr<FFTPlan<double>> fft_plan_inverse_tail_;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan_inverse_tail_;
+    std::vector<void*>               inverse_blocks_;
+
+    // Ragged batches: spectra of the last batch, in whole chunks of batch_frames_ rows
+    size_t                           batch_frames_;
+    std::unique_ptr<FFTPlan<double>> fft_plan_batch_;
+    std::unique_ptr<FFTPlan<float>>  fftf_plan_batch_;
+    std::vector<STFTScratch>         batch_scratch_;
+    void*                            batch_spectra_;
+    size_t                           batch_capacity_;
+    size_t                           batch_rows_;
+
+    // RGBA lookup table for images
+    std::vector<unsigned char> colormap_;
+
+    // Range queries: tiles of chunk_frames_ rows of power, most recently used first
+    struct PowerTile {
+        size_t                     index;
+        std::vector<unsigned char> power;
+    };
+    const void*                                                bound_signal_;
+    void*                                                      tile_spectra_;
+    size_t                                                     max_tiles_;
+    std::list<PowerTile>                                       tiles_;
+    std::unordered_map<size_t, std::list<PowerTile>::iterator> tile_lookup_;
+
+    // Sliding DFT-related
+    std::unique_ptr<FFTPlan<double>>  fft_plan_single_;
+    std::unique_ptr<FFTPlan<float>>   fftf_plan_single_;
+    size_t                            sdft_num_terms_;
+    size_t                            sdft_anchor_interval_;
+    std::vector<double>               sdft_weights_;
+    std::vector<std::complex<double>> sdft_rotation_;
+    std::vector<std::complex<double>> sdft_entry_;
 };
 
 #endif /* STFT_H */
@@ -0,0 +1,209 @@
+#include "tuning.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "stft.h"
+
+// Header written to new tuning databases
+static const char* kTuningHeader =
+    "# libspectrogram tuning v1: data_size transform_length window_length window_overlap window_type windows_log2 "
+    "execution_mode planner_rigor chunk_frames num_threads seconds\n";
+
+// Number of segments transformed when timing a strategy. Longer signals are timed on a prefix.
+static const size_t kTuningWindows = 4096;
+
+// Number of timed executions of each strategy, of which the fastest is kept
+static const int kTuningRepeats = 3;
+
+static bool same_key(const TuningKey& a, const TuningKey& b) {
+    return a.data_size == b.data_size && a.transform_length == b.transform_length &&
+           a.window_length == b.window_length && a.window_overlap == b.window_overlap &&
+           a.window_type == b.window_type && a.windows_log2 == b.windows_log2;
+}
+
+bool load_tuning(const std::string& filename, const TuningKey& key, TuningEntry* entry) {
+    FILE* file = fopen(filename.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+
+    char        line[512];
+    bool        found = false;
+    TuningKey   line_key;
+    TuningEntry line_entry;
+    int         window_type, execution_mode, planner_rigor;
+
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') {
+            continue;
+        }
+
+        const int num_fields =
+            sscanf(line, "%d %zu %zu %zu %d %d %d %d %zu %d %lf", &line_key.data_size, &line_key.transform_length,
+                   &line_key.window_length, &line_key.window_overlap, &window_type, &line_key.windows_log2,
+                   &execution_mode, &planner_rigor, &line_entry.chunk_frames, &line_entry.num_threads,
+                   &line_entry.seconds);
+        if (num_fields != 11) {
+            continue;
+        }
+
+        line_key.window_type      = (WindowType)window_type;
+        line_entry.execution_mode = (ExecutionMode)execution_mode;
+        line_entry.planner_rigor  = (PlannerRigor)planner_rigor;
+        if (same_key(key, line_key)) {
+            *entry = line_entry;
+            found  = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+bool store_tuning(const std::string& filename, const TuningKey& key, const TuningEntry& entry) {
+    FILE* file = fopen(filename.c_str(), "a");
+    if (!file) {
+        fprintf(stderr, "WARNING: Could not open tuning database %s for writing.", filename.c_str());
+        return false;
+    }
+
+    if (ftell(file) == 0) {
+        fputs(kTuningHeader, file);
+    }
+    fprintf(file, "%d %zu %zu %zu %d %d %d %d %zu %d %.9g\n", key.data_size, key.transform_length, key.window_length,
+            key.window_overlap, (int)key.window_type, key.windows_log2, (int)entry.execution_mode,
+            (int)entry.planner_rigor, entry.chunk_frames, entry.num_threads, entry.seconds);
+
+    fclose(file);
+    return true;
+}
+
+// Best time of several executions of one strategy, excluding planning
+template <typename T>
+static double time_strategy(const SpectrogramInput& input, const SpectrogramConfig& config,
+                            const std::vector<T>& signal, ExecutionMode* selected_mode) {
+    STFT transform(input, config);
+    *selected_mode = transform.execution_mode();
+
+    // Warm up
+    transform.compute((void*)signal.data());
+
+    double best = 0.0;
+    for (int repeat = 0; repeat < kTuningRepeats; repeat++) {
+        const auto start = std::chrono::steady_clock::now();
+        transform.compute((void*)signal.data());
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (repeat == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+// Coordinate search: execution mode and planner rigor first, then chunk size and thread count for FFT execution
+template <typename T>
+static TuningEntry measure(SpectrogramInput input, SpectrogramConfig config) {
+    const size_t window_increment = config.window_length - config.window_overlap;
+    const size_t max_samples      = (kTuningWindows - 1) * window_increment + config.window_length;
+
+    // Strategies are timed on the signal as it is segmented, after any resampling
+    if (config.decimation > 1 || config.interpolation > 1) {
+        const Resampler resampler(std::max(config.interpolation, (size_t)1), std::max(config.decimation, (size_t)1));
+        input.num_samples    = resampler.output_length(input.num_samples);
+        config.decimation    = 0;
+        config.interpolation = 0;
+    }
+
+    // Time a contiguous noise signal as long as the input, up to a bounded number of segments
+    input.num_samples = std::min(input.num_samples, max_samples);
+    input.stride      = 1;
+    std::vector<T> signal(input.num_samples);
+    unsigned long  state = 1;
+    for (size_t i = 0; i < signal.size(); i++) {
+        state     = (state * 1103515245 + 12345) % 2147483648;
+        signal[i] = (T)state / (T)2147483648.0 - (T)0.5;
+    }
+
+    config.autotune    = 0;
+    config.tuning_file = NULL;
+
+    std::vector<ExecutionMode> modes;
+    std::vector<PlannerRigor>  rigors;
+    std::vector<size_t>        chunks;
+    std::vector<int>           threads;
+
+    if (config.execution_mode == EXECUTION_AUTO) {
+        modes = {EXECUTION_FFT, EXECUTION_SLIDING_DFT};
+    } else {
+        modes = {config.execution_mode};
+    }
+    if (config.planner_rigor == PLANNER_DEFAULT) {
+        rigors = {PLANNER_ESTIMATE, PLANNER_MEASURE, PLANNER_PATIENT};
+    } else {
+        rigors = {config.planner_rigor};
+    }
+    if (config.chunk_frames == 0) {
+        chunks = {16, 64, 256, 1024};
+    } else {
+        chunks = {config.chunk_frames};
+    }
+    if (config.num_threads == 0) {
+        threads = {1};
+        for (int count = 2; count <= (int)std::thread::hardware_concurrency(); count *= 2) {
+            threads.push_back(count);
+        }
+    } else {
+        threads = {config.num_threads};
+    }
+
+    TuningEntry   best     = {EXECUTION_FFT, rigors[0], chunks[0], threads[0], -1.0};
+    ExecutionMode selected = EXECUTION_FFT;
+    auto          consider = [&](ExecutionMode mode, PlannerRigor rigor, size_t chunk, int num_threads) {
+        config.execution_mode = mode;
+        config.planner_rigor  = rigor;
+        config.chunk_frames   = chunk;
+        config.num_threads    = num_threads;
+
+        const double seconds = time_strategy<T>(input, config, signal, &selected);
+        if (selected != mode) {
+            return;
+        }
+        if (best.seconds < 0.0 || seconds < best.seconds) {
+            best = {mode, rigor, chunk, num_threads, seconds};
+        }
+    };
+
+    for (ExecutionMode mode : modes) {
+        for (PlannerRigor rigor : rigors) {
+            consider(mode, rigor, chunks[0], threads[0]);
+        }
+    }
+
+    if (best.execution_mode == EXECUTION_FFT) {
+        const TuningEntry coarse = best;
+        for (size_t chunk : chunks) {
+            if (chunk != coarse.chunk_frames) {
+                consider(coarse.execution_mode, coarse.planner_rigor, chunk, coarse.num_threads);
+            }
+        }
+
+        const TuningEntry medium = best;
+        for (int num_threads : threads) {
+            if (num_threads != medium.num_threads) {
+                consider(medium.execution_mode, medium.planner_rigor, medium.chunk_frames, num_threads);
+            }
+        }
+    }
+
+    return best;
+}
+
+TuningEntry measure_tuning(const SpectrogramInput& input, const SpectrogramConfig& config) {
+    if (input.data_size == sizeof(float)) {
+        return measure<float>(input, config);
+    }
+    return measure<double>(input, config);
+}
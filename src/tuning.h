@@ -0,0 +1,34 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <string>
+
+#include "spectrogram.h"
+
+// Configurations sharing a tuning entry: the same segments, and a number of segments within a factor of two
+struct TuningKey {
+    int        data_size;
+    size_t     transform_length;
+    size_t     window_length;
+    size_t     window_overlap;
+    WindowType window_type;
+    int        windows_log2;
+};
+
+// The fastest strategy measured for a key, and the time it took to transform the measured signal
+struct TuningEntry {
+    ExecutionMode execution_mode;
+    PlannerRigor  planner_rigor;
+    size_t        chunk_frames;
+    int           num_threads;
+    double        seconds;
+};
+
+// Tuning database: a text file of one entry per line, the most recent entry for a key winning
+bool load_tuning(const std::string& filename, const TuningKey& key, TuningEntry* entry);
+bool store_tuning(const std::string& filename, const TuningKey& key, const TuningEntry& entry);
+
+// Time the candidate strategies for a configuration. Fields pinned in the configuration are not varied.
+TuningEntry measure_tuning(const SpectrogramInput& input, const SpectrogramConfig& config);
+
+#endif /* TUNING_H */
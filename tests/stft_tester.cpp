@@ -1,4 +1,5 @@
 #include "stft_tester.h"
+#include <cmath>
 
 double MaxError(std::vector<double> v1, std::vector<double> v2) {
     if (v1.size() != v2.size())
@@ -11,6 +12,28 @@ double MaxError(std::vector<double> v1, std::vector<double> v2) {
     return error;
 }
 
+// Deterministic sum of sinusoids plus pseudo-random noise
+std::vector<double> NoisySignal(size_t num_samples) {
+    std::vector<double> signal(num_samples);
+    unsigned long       state = 12345;
+    for (size_t i = 0; i < num_samples; i++) {
+        state     = (state * 1103515245 + 12345) % 2147483648;
+        signal[i] = sin(0.3 * i) + 0.5 * cos(0.05 * i) + (double)state / 2147483648.0 - 0.5;
+    }
+    return signal;
+}
+
+std::vector<double> ComputePower(SpectrogramInput props, SpectrogramConfig config, std::vector<double> input) {
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    std::vector<double> power(spectrogram_get_timelen(transform) * spectrogram_get_freqlen(transform));
+    spectrogram_get_power(transform, power.data());
+    spectrogram_destroy(transform);
+
+    return power;
+}
+
 void STFT_Tester::TearDown() {
     spectrogram_destroy(stft);
 }
@@ -53,4 +76,98 @@ void STFT_Tester::TestPhase() {
     spectrogram_get_phase(stft, phase_observed.data());
 
     EXPECT_LT(MaxError(phase, phase_observed), .0001);
-}
\ No newline at end of file
+}
+void STFT_Tester::TestPowerPhase() {
+    std::vector<double> power_observed(power.size());
+    std::vector<double> phase_observed(phase.size());
+    spectrogram_get_power_phase(stft, power_observed.data(), phase_observed.data());
+
+    EXPECT_LT(MaxError(power, power_observed), .0001);
+    EXPECT_LT(MaxError(phase, phase_observed), .0001);
+}
+
+void STFT_Tester::TestPeriodogram() {
+    const unsigned long freqlen = spectrogram_get_freqlen(stft);
+
+    std::vector<double> periodogram(freqlen, 0.0);
+    for (unsigned long i = 0; i < power.size(); i++)
+        periodogram[i % freqlen] += power[i];
+
+    std::vector<double> periodogram_observed(freqlen);
+    spectrogram_get_power_periodogram(stft, periodogram_observed.data());
+
+    EXPECT_LT(MaxError(periodogram, periodogram_observed), .0001 * spectrogram_get_timelen(stft));
+}
+
+void STFT_Tester::TestCachedViews() {
+    SpectrogramConfig cached_config = config;
+    cached_config.cache_outputs     = 1;
+
+    SpectrogramTransform* cached = spectrogram_create(&props, &cached_config);
+    spectrogram_execute(cached, (props.stride == 1) ? input.data() : input.data() + 1);
+
+    const double* power_view = (const double*)spectrogram_get_power_view(cached);
+    const double* phase_view = (const double*)spectrogram_get_phase_view(cached);
+    EXPECT_LT(MaxError(power, std::vector<double>(power_view, power_view + power.size())), .0001);
+    EXPECT_LT(MaxError(phase, std::vector<double>(phase_view, phase_view + phase.size())), .0001);
+
+    // Repeated getters copy the cached outputs
+    std::vector<double> power_observed(power.size());
+    spectrogram_get_power(cached, power_observed.data());
+    EXPECT_EQ(std::vector<double>(power_view, power_view + power.size()), power_observed);
+
+    spectrogram_destroy(cached);
+}
+
+void STFT_Tester::TestStridedOutput() {
+    const unsigned long timelen = spectrogram_get_timelen(stft);
+    const unsigned long freqlen = spectrogram_get_freqlen(stft);
+
+    // Frequency-major power with the highest frequency in the first row
+    std::vector<double> image(timelen * freqlen);
+    SpectrogramOutput   power_out;
+    power_out.data        = image.data() + (freqlen - 1) * timelen;
+    power_out.time_stride = 1;
+    power_out.freq_stride = -(ptrdiff_t)timelen;
+
+    // Phase into every other column of a wider buffer
+    std::vector<double> wide(2 * timelen * freqlen);
+    SpectrogramOutput   phase_out;
+    phase_out.data        = wide.data();
+    phase_out.time_stride = 2 * freqlen;
+    phase_out.freq_stride = 2;
+
+    spectrogram_get_power_phase_strided(stft, &power_out, &phase_out);
+
+    std::vector<double> power_observed(power.size());
+    std::vector<double> phase_observed(phase.size());
+    for (unsigned long t = 0; t < timelen; t++) {
+        for (unsigned long f = 0; f < freqlen; f++) {
+            power_observed[t * freqlen + f] = image[(freqlen - 1 - f) * timelen + t];
+            phase_observed[t * freqlen + f] = wide[t * 2 * freqlen + 2 * f];
+        }
+    }
+
+    EXPECT_LT(MaxError(power, power_observed), .0001);
+    EXPECT_LT(MaxError(phase, phase_observed), .0001);
+}
+
+void STFT_Tester::TestSpectraView() {
+    SpectrogramSpectraView view;
+    spectrogram_get_spectra_view(stft, &view);
+
+    EXPECT_EQ(view.layout, SPECTRA_HALFCOMPLEX);
+    EXPECT_EQ(view.num_rows, spectrogram_get_timelen(stft));
+    EXPECT_EQ(view.row_length, config.transform_length);
+    EXPECT_EQ(view.data_size, (int)sizeof(double));
+
+    // Recover the phase of the first non-DC bin from the raw spectra
+    const double* spectra = (const double*)view.data;
+    for (unsigned long t = 0; t < view.num_rows; t++) {
+        const double* row = spectra + t * view.row_pitch;
+        if (view.row_length > 2) {
+            const double expected = phase[t * spectrogram_get_freqlen(stft) + 1];
+            EXPECT_NEAR(atan2(row[view.row_length - 1], row[1]), expected, .0001);
+        }
+    }
+}
@@ -6,9 +6,12 @@
 #include "spectrogram.h"
 
 double MaxError(std::vector<double> v1, std::vector<double> v2);
+std::vector<double> NoisySignal(size_t num_samples);
+std::vector<double> ComputePower(SpectrogramInput props, SpectrogramConfig config, std::vector<double> input);
 
 class STFT_Tester : public ::testing::Test {
    protected:
+    STFT_Tester() { spectrogram_init_config(&config); }
     SpectrogramInput      props;
     SpectrogramConfig     config;
     SpectrogramTransform* stft;
@@ -22,6 +25,11 @@ class STFT_Tester : public ::testing::Test {
     void                  TestFrequency();
     void                  TestPower();
     void                  TestPhase();
+    void                  TestPowerPhase();
+    void                  TestPeriodogram();
+    void                  TestCachedViews();
+    void                  TestStridedOutput();
+    void                  TestSpectraView();
 };
 
 #endif /* STFT_TESTER_H */
@@ -1,4 +1,18 @@
 #include "cases.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "spectrogram.hpp"
+
+#ifdef WITH_DAEMON
+#include <unistd.h>
+#include <cstring>
+#include "server.h"
+#include "spectrogram_client.h"
+#endif
 
 // Test time vectors
 TEST_F(STFT_Test_1, Time) {
@@ -78,4 +92,1773 @@ TEST_F(STFT_Test_5, Phase) {
 }
 TEST_F(STFT_Test_6, Phase) {
     TestPhase();
-}
\ No newline at end of file
+}
+// Test combined power and phase
+TEST_F(STFT_Test_1, PowerPhase) {
+    TestPowerPhase();
+}
+TEST_F(STFT_Test_2, PowerPhase) {
+    TestPowerPhase();
+}
+TEST_F(STFT_Test_3, PowerPhase) {
+    TestPowerPhase();
+}
+TEST_F(STFT_Test_4, PowerPhase) {
+    TestPowerPhase();
+}
+TEST_F(STFT_Test_5, PowerPhase) {
+    TestPowerPhase();
+}
+TEST_F(STFT_Test_6, PowerPhase) {
+    TestPowerPhase();
+}
+
+// Test power periodogram
+TEST_F(STFT_Test_1, Periodogram) {
+    TestPeriodogram();
+}
+TEST_F(STFT_Test_2, Periodogram) {
+    TestPeriodogram();
+}
+TEST_F(STFT_Test_3, Periodogram) {
+    TestPeriodogram();
+}
+TEST_F(STFT_Test_4, Periodogram) {
+    TestPeriodogram();
+}
+TEST_F(STFT_Test_5, Periodogram) {
+    TestPeriodogram();
+}
+TEST_F(STFT_Test_6, Periodogram) {
+    TestPeriodogram();
+}
+
+// Test cached output views
+TEST_F(STFT_Test_1, CachedViews) {
+    TestCachedViews();
+}
+TEST_F(STFT_Test_2, CachedViews) {
+    TestCachedViews();
+}
+TEST_F(STFT_Test_3, CachedViews) {
+    TestCachedViews();
+}
+TEST_F(STFT_Test_4, CachedViews) {
+    TestCachedViews();
+}
+TEST_F(STFT_Test_5, CachedViews) {
+    TestCachedViews();
+}
+TEST_F(STFT_Test_6, CachedViews) {
+    TestCachedViews();
+}
+
+// Test strided output descriptors
+TEST_F(STFT_Test_1, StridedOutput) {
+    TestStridedOutput();
+}
+TEST_F(STFT_Test_2, StridedOutput) {
+    TestStridedOutput();
+}
+TEST_F(STFT_Test_3, StridedOutput) {
+    TestStridedOutput();
+}
+TEST_F(STFT_Test_4, StridedOutput) {
+    TestStridedOutput();
+}
+TEST_F(STFT_Test_5, StridedOutput) {
+    TestStridedOutput();
+}
+TEST_F(STFT_Test_6, StridedOutput) {
+    TestStridedOutput();
+}
+
+// Test complex spectra view
+TEST_F(STFT_Test_1, SpectraView) {
+    TestSpectraView();
+}
+TEST_F(STFT_Test_2, SpectraView) {
+    TestSpectraView();
+}
+TEST_F(STFT_Test_3, SpectraView) {
+    TestSpectraView();
+}
+TEST_F(STFT_Test_4, SpectraView) {
+    TestSpectraView();
+}
+TEST_F(STFT_Test_5, SpectraView) {
+    TestSpectraView();
+}
+TEST_F(STFT_Test_6, SpectraView) {
+    TestSpectraView();
+}
+
+// Test sliding DFT against FFT
+TEST(SlidingDFT, MatchesFFT) {
+    const WindowType          windows[]           = {RECTANGULAR, HANN, HAMMING, BLACKMAN, NUTTALL, BLACKMAN_HARRIS};
+    const size_t              transform_lengths[] = {32, 45};
+    const std::vector<double> input               = NoisySignal(5000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.padding_mode   = PAD;
+    config.window_length  = 32;
+    config.window_overlap = 30;
+
+    for (WindowType window : windows) {
+        for (size_t transform_length : transform_lengths) {
+            config.window_type      = window;
+            config.transform_length = transform_length;
+
+            config.execution_mode          = EXECUTION_FFT;
+            std::vector<double> fft_power  = ComputePower(props, config, input);
+            config.execution_mode          = EXECUTION_SLIDING_DFT;
+            std::vector<double> sdft_power = ComputePower(props, config, input);
+
+            EXPECT_LT(MaxError(fft_power, sdft_power), 1e-9);
+        }
+    }
+}
+
+ExecutionMode SelectedMode(SpectrogramInput props, SpectrogramConfig config) {
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    ExecutionMode         mode      = spectrogram_get_execution_mode(transform);
+    spectrogram_destroy(transform);
+    return mode;
+}
+
+TEST(SlidingDFT, SelectedForSmallHops) {
+    SpectrogramInput props;
+    props.sample_rate = 1;
+    props.num_samples = 10000;
+    props.data_size   = sizeof(float);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 256;
+    config.window_overlap   = 255;
+    config.transform_length = 256;
+    EXPECT_EQ(SelectedMode(props, config), EXECUTION_SLIDING_DFT);
+
+    config.window_overlap = 128;
+    EXPECT_EQ(SelectedMode(props, config), EXECUTION_FFT);
+
+    config.window_type    = WELCH;
+    config.window_overlap = 255;
+    EXPECT_EQ(SelectedMode(props, config), EXECUTION_FFT);
+}
+
+// Test concurrent execution of one transform with per-thread workspaces
+TEST(Concurrency, WorkspacesMatchSerial) {
+    const unsigned long num_threads = 4;
+    const ExecutionMode modes[]     = {EXECUTION_FFT, EXECUTION_SLIDING_DFT};
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = 600;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 32;
+    config.window_overlap   = 28;
+    config.transform_length = 32;
+
+    for (ExecutionMode mode : modes) {
+        config.execution_mode = mode;
+
+        // Serial reference for a differently scaled signal per thread
+        std::vector<std::vector<double>> inputs, expected;
+        for (unsigned long t = 0; t < num_threads; t++) {
+            inputs.push_back(NoisySignal(props.num_samples));
+            for (double& x : inputs.back())
+                x *= (t + 1.0);
+            expected.push_back(ComputePower(props, config, inputs.back()));
+        }
+
+        SpectrogramTransform*            transform = spectrogram_create(&props, &config);
+        std::vector<std::vector<double>> observed(num_threads);
+        std::vector<std::thread>         threads;
+
+        for (unsigned long t = 0; t < num_threads; t++) {
+            threads.push_back(std::thread([&, t]() {
+                SpectrogramWorkspace* workspace = spectrogram_workspace_create(transform);
+                observed[t].resize(expected[t].size());
+                for (int repeat = 0; repeat < 3; repeat++) {
+                    spectrogram_execute_workspace(transform, workspace, inputs[t].data());
+                    spectrogram_workspace_get_power_phase(transform, workspace, observed[t].data(), NULL);
+                }
+                spectrogram_workspace_destroy(transform, workspace);
+            }));
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+
+        for (unsigned long t = 0; t < num_threads; t++)
+            EXPECT_LT(MaxError(expected[t], observed[t]), 1e-9);
+
+        spectrogram_destroy(transform);
+    }
+}
+
+// Test concurrent creation and destruction of transforms
+TEST(Concurrency, CreateDestroy) {
+    SpectrogramInput props;
+    props.sample_rate = 1;
+    props.num_samples = 256;
+    props.data_size   = sizeof(float);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HAMMING;
+    config.window_length    = 16;
+    config.window_overlap   = 8;
+    config.transform_length = 16;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&]() {
+            for (int i = 0; i < 10; i++)
+                spectrogram_destroy(spectrogram_create(&props, &config));
+        }));
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+TEST(Chunking, MatchesSingleSegments) {
+    const std::vector<double> input = NoisySignal(40000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.padding_mode     = PAD;
+    config.window_type      = HANN;
+    config.window_length    = 16;
+    config.window_overlap   = 15;
+    config.transform_length = 16;
+    config.execution_mode   = EXECUTION_FFT;
+
+    // Enough segments to span several chunks plus a partial one
+    const std::vector<double> power     = ComputePower(props, config, input);
+    const size_t              freq_len  = config.transform_length / 2 + 1;
+    const size_t              time_len  = power.size() / freq_len;
+    const size_t              windows[] = {0, 1, 8191, 8192, 8193, 32767, 32768, time_len - 1};
+    ASSERT_EQ(time_len, input.size() - config.window_length + 1);
+
+    for (size_t window : windows) {
+        std::vector<double> segment(input.begin() + window, input.begin() + std::min(window + 16, input.size()));
+        props.num_samples = segment.size();
+
+        const std::vector<double> expected = ComputePower(props, config, segment);
+        const std::vector<double> observed(power.begin() + window * freq_len, power.begin() + (window + 1) * freq_len);
+        EXPECT_LT(MaxError(expected, observed), 1e-12) << "window " << window;
+    }
+}
+
+TEST(RangeQuery, MatchesFullExecution) {
+    std::vector<double> input = NoisySignal(60000);
+
+    SpectrogramInput props;
+    props.sample_rate = 1000;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HAMMING;
+    config.window_length    = 64;
+    config.window_overlap   = 48;
+    config.transform_length = 64;
+    config.cache_tiles      = 2;
+
+    const std::vector<double> full     = ComputePower(props, config, input);
+    const size_t              freq_len = config.transform_length / 2 + 1;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_bind(transform, input.data());
+
+    // Pan back and forth across tile boundaries so tiles are both reused and evicted
+    const double starts[] = {0.0, 2.5, 3.0, 40.0, 2.9, 59.5, 0.01};
+    for (double start : starts) {
+        size_t       first_window;
+        const size_t time_len = spectrogram_get_range_timelen(transform, start, start + 3.0, &first_window);
+        ASSERT_GT(time_len, 0u);
+
+        std::vector<double> power(time_len * freq_len);
+        spectrogram_get_power_range(transform, start, start + 3.0, power.data());
+
+        const std::vector<double> expected(full.begin() + first_window * freq_len,
+                                           full.begin() + (first_window + time_len) * freq_len);
+        EXPECT_EQ(MaxError(expected, power), 0.0) << "start " << start;
+    }
+
+    spectrogram_destroy(transform);
+}
+
+TEST(RangeQuery, OverlappingWindows) {
+    SpectrogramInput props;
+    props.sample_rate = 10;
+    props.num_samples = 100;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_length    = 10;
+    config.window_overlap   = 5;
+    config.transform_length = 10;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    size_t                first_window;
+
+    // Segments start every 0.5s and last 1s
+    EXPECT_EQ(spectrogram_get_range_timelen(transform, 0.0, 0.5, &first_window), 1u);
+    EXPECT_EQ(first_window, 0u);
+    EXPECT_EQ(spectrogram_get_range_timelen(transform, 2.0, 3.0, &first_window), 3u);
+    EXPECT_EQ(first_window, 3u);
+    EXPECT_EQ(spectrogram_get_range_timelen(transform, 9.5, 20.0, &first_window), 1u);
+    EXPECT_EQ(first_window, 18u);
+    EXPECT_EQ(spectrogram_get_range_timelen(transform, 10.0, 20.0, &first_window), 0u);
+    EXPECT_EQ(spectrogram_get_range_timelen(transform, 3.0, 2.0, &first_window), 0u);
+
+    spectrogram_destroy(transform);
+}
+
+TEST(MemoryBudget, TiledMatchesUntiled) {
+    std::vector<double> input = NoisySignal(20000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = BLACKMAN;
+    config.window_length    = 100;
+    config.window_overlap   = 60;
+    config.transform_length = 128;
+
+    SpectrogramTransform* full       = spectrogram_create(&props, &config);
+    const size_t          full_bytes = spectrogram_estimate_memory(&props, &config);
+
+    // Budget far below the full spectra buffer
+    config.max_memory_bytes           = full_bytes / 8;
+    SpectrogramTransform* tiled       = spectrogram_create(&props, &config);
+    const size_t          tiled_bytes = spectrogram_estimate_memory(&props, &config);
+    EXPECT_LE(tiled_bytes, config.max_memory_bytes);
+    spectrogram_execute(full, input.data());
+    spectrogram_execute(tiled, input.data());
+
+    const size_t        numel = spectrogram_get_timelen(full) * spectrogram_get_freqlen(full);
+    std::vector<double> full_power(numel), full_phase(numel), tiled_power(numel), tiled_phase(numel);
+    spectrogram_get_power_phase(full, full_power.data(), full_phase.data());
+    spectrogram_get_power_phase(tiled, tiled_power.data(), tiled_phase.data());
+    EXPECT_EQ(MaxError(full_power, tiled_power), 0.0);
+    EXPECT_EQ(MaxError(full_phase, tiled_phase), 0.0);
+
+    std::vector<double> full_periodogram(spectrogram_get_freqlen(full));
+    std::vector<double> tiled_periodogram(spectrogram_get_freqlen(full));
+    spectrogram_get_power_periodogram(full, full_periodogram.data());
+    spectrogram_get_power_periodogram(tiled, tiled_periodogram.data());
+    EXPECT_LT(MaxError(full_periodogram, tiled_periodogram), 1e-9);
+
+    SpectrogramSpectraView view;
+    spectrogram_get_spectra_view(tiled, &view);
+    EXPECT_EQ(view.num_rows, 0u);
+
+    spectrogram_destroy(full);
+    spectrogram_destroy(tiled);
+}
+
+TEST(Tuning, RecordsAndReusesStrategy) {
+    const std::string         tuning_file = testing::TempDir() + "spectrogram_tuning_test.txt";
+    const std::vector<double> input       = NoisySignal(8000);
+    std::remove(tuning_file.c_str());
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 64;
+    config.window_overlap   = 32;
+    config.transform_length = 64;
+
+    const std::vector<double> expected = ComputePower(props, config, input);
+
+    // Tune once, then reuse the recorded strategy
+    config.tuning_file = tuning_file.c_str();
+    config.autotune    = 1;
+    EXPECT_LT(MaxError(expected, ComputePower(props, config, input)), 1e-9);
+
+    FILE* file = fopen(tuning_file.c_str(), "r");
+    ASSERT_TRUE(file != NULL);
+    char header[512];
+    char entry[512];
+    EXPECT_TRUE(fgets(header, sizeof(header), file) != NULL);
+    EXPECT_TRUE(fgets(entry, sizeof(entry), file) != NULL);
+    fclose(file);
+
+    config.autotune = 0;
+    EXPECT_LT(MaxError(expected, ComputePower(props, config, input)), 1e-9);
+
+    // Pinned fields override the recorded strategy
+    config.num_threads  = 4;
+    config.chunk_frames = 16;
+    EXPECT_LT(MaxError(expected, ComputePower(props, config, input)), 1e-9);
+
+    std::remove(tuning_file.c_str());
+    std::remove((tuning_file + ".fftw-wisdom").c_str());
+}
+
+TEST(EnergyGate, SkipsSilentSegments) {
+    // Silence with two bursts of noise
+    std::vector<double> input(20000, 0.0);
+    std::vector<double> noise = NoisySignal(1000);
+    std::copy(noise.begin(), noise.end(), input.begin() + 3000);
+    std::copy(noise.begin(), noise.end(), input.begin() + 15500);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 128;
+    config.window_overlap   = 96;
+    config.transform_length = 128;
+
+    const std::vector<double> expected = ComputePower(props, config, input);
+
+    config.gate_threshold           = 1e-6;
+    config.gate_floor               = -1.0;
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    const size_t               time_len = spectrogram_get_timelen(transform);
+    const size_t               freq_len = spectrogram_get_freqlen(transform);
+    std::vector<double>        power(time_len * freq_len);
+    std::vector<unsigned char> mask(time_len);
+    spectrogram_get_power(transform, power.data());
+    spectrogram_get_frame_mask(transform, mask.data());
+
+    size_t num_active = 0;
+    for (size_t window = 0; window < time_len; window++) {
+        const size_t start  = window * 32;
+        const bool   silent = (start + 128 <= 3000) || (start >= 4000 && start + 128 <= 15500) || (start >= 16500);
+        EXPECT_EQ(mask[window], silent ? 0 : 1) << "window " << window;
+
+        for (size_t freq = 0; freq < freq_len; freq++) {
+            const double value = power[window * freq_len + freq];
+            EXPECT_NEAR(value, mask[window] ? expected[window * freq_len + freq] : -1.0, 1e-9);
+        }
+        num_active += mask[window];
+    }
+    EXPECT_LT(num_active, time_len / 4);
+
+    // Skipped segments have no cepstrum
+    std::vector<double> cepstrum(time_len * freq_len), expected_cepstrum(time_len * freq_len);
+    spectrogram_get_cepstrum(transform, cepstrum.data());
+    config.gate_threshold         = 0.0;
+    SpectrogramTransform* ungated = spectrogram_create(&props, &config);
+    spectrogram_execute(ungated, input.data());
+    spectrogram_get_cepstrum(ungated, expected_cepstrum.data());
+    spectrogram_destroy(ungated);
+    for (size_t index = 0; index < cepstrum.size(); index++) {
+        EXPECT_NEAR(cepstrum[index], mask[index / freq_len] ? expected_cepstrum[index] : 0.0, 1e-9);
+    }
+    spectrogram_destroy(transform);
+
+    // Chunks mixing active and silent segments, preprocessed once per chunk
+    config.detrend                         = DETREND_LINEAR;
+    config.pre_emphasis                    = 0.97;
+    const std::vector<double> preprocessed = ComputePower(props, config, input);
+
+    config.gate_threshold = 1e-6;
+    transform             = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+    spectrogram_get_power(transform, power.data());
+    spectrogram_get_frame_mask(transform, mask.data());
+    for (size_t window = 0; window < time_len; window++) {
+        for (size_t freq = 0; freq < freq_len; freq++) {
+            const double value = power[window * freq_len + freq];
+            EXPECT_NEAR(value, mask[window] ? preprocessed[window * freq_len + freq] : -1.0, 1e-9);
+        }
+    }
+    spectrogram_destroy(transform);
+}
+
+TEST(Features, MatchPowerAndStream) {
+    std::vector<double>       input    = NoisySignal(4000);
+    const unsigned int        features = FEATURE_CENTROID | FEATURE_BANDWIDTH | FEATURE_FLUX | FEATURE_ROLLOFF |
+                                  FEATURE_FLATNESS;
+
+    SpectrogramInput props;
+    props.sample_rate = 1000;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 100;
+    config.window_overlap   = 50;
+    config.transform_length = 128;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    const size_t        time_len = spectrogram_get_timelen(transform);
+    const size_t        freq_len = spectrogram_get_freqlen(transform);
+    std::vector<double> power(time_len * freq_len), freq(freq_len), observed(time_len * 5);
+    spectrogram_get_power(transform, power.data());
+    spectrogram_get_freq(transform, freq.data());
+    spectrogram_get_features(transform, features, observed.data());
+
+    // Reference features from the full power matrix
+    for (size_t t = 0; t < time_len; t++) {
+        const double* row   = power.data() + t * freq_len;
+        double        total = 0, centroid = 0, spread = 0, log_sum = 0, flux = 0, cumulative = 0, rolloff = -1;
+        for (size_t f = 0; f < freq_len; f++) {
+            total += row[f];
+            centroid += row[f] * freq[f];
+            log_sum += log(row[f]);
+            flux += (t > 0) ? pow(row[f] - row[f - freq_len], 2) : 0.0;
+        }
+        centroid /= total;
+        for (size_t f = 0; f < freq_len; f++) {
+            spread += row[f] * pow(freq[f] - centroid, 2) / total;
+            cumulative += row[f];
+            if (rolloff < 0 && cumulative >= 0.85 * total) {
+                rolloff = freq[f];
+            }
+        }
+
+        const double* out = observed.data() + t * 5;
+        EXPECT_NEAR(out[0], centroid, 1e-9 * centroid);
+        EXPECT_NEAR(out[1], sqrt(spread), 1e-6 * sqrt(spread));
+        EXPECT_NEAR(out[2], sqrt(flux), 1e-9 * (1 + sqrt(flux)));
+        EXPECT_EQ(out[3], rolloff);
+        EXPECT_NEAR(out[4], exp(log_sum / freq_len) / (total / freq_len), 1e-9);
+    }
+    spectrogram_destroy(transform);
+
+    // Streaming the same signal in two blocks gives the same flux, including across the block boundary
+    props.num_samples               = 2000;
+    SpectrogramTransform* block     = spectrogram_create(&props, &config);
+    SpectrogramWorkspace* workspace = spectrogram_workspace_create(block);
+    const size_t          block_len = spectrogram_get_timelen(block);
+    std::vector<double>   block_flux(2 * block_len);
+    for (size_t b = 0; b < 2; b++) {
+        spectrogram_execute_workspace(block, workspace, input.data() + b * 2000);
+        spectrogram_workspace_get_features(block, workspace, FEATURE_FLUX, block_flux.data() + b * block_len);
+    }
+    EXPECT_EQ(block_flux[0], 0.0);
+    EXPECT_GT(block_flux[block_len], 0.0);
+    for (size_t t = 1; t < block_len; t++) {
+        EXPECT_NEAR(block_flux[t], observed[t * 5 + 2], 1e-9 * observed[t * 5 + 2]);
+    }
+    spectrogram_workspace_destroy(block, workspace);
+    spectrogram_destroy(block);
+}
+
+TEST(Peaks, FindsTonesStrongestFirst) {
+    // Two tones between bins and a weak noise floor
+    std::vector<double>       input = NoisySignal(8000);
+    const std::vector<double> tones = {103.3, 250.7};
+    const std::vector<double> gains = {1.0, 0.5};
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] *= 1e-3;
+        for (size_t tone = 0; tone < tones.size(); tone++) {
+            input[i] += gains[tone] * sin(2.0 * M_PI * tones[tone] * i / 1000.0);
+        }
+    }
+
+    SpectrogramInput props;
+    props.sample_rate = 1000;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 200;
+    config.window_overlap   = 100;
+    config.transform_length = 256;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    const size_t        K        = 3;
+    const size_t        time_len = spectrogram_get_timelen(transform);
+    const size_t        freq_len = spectrogram_get_freqlen(transform);
+    std::vector<double> freq(time_len * K), peak_power(time_len * K), power(time_len * freq_len);
+    spectrogram_get_peaks(transform, K, 3, freq.data(), peak_power.data());
+    spectrogram_get_power(transform, power.data());
+
+    // Interpolation is within a fraction of the 3.9 Hz bin spacing
+    for (size_t t = 0; t < time_len; t++) {
+        EXPECT_NEAR(freq[t * K], tones[0], 0.5);
+        EXPECT_NEAR(freq[t * K + 1], tones[1], 0.5);
+        EXPECT_GE(peak_power[t * K], peak_power[t * K + 1]);
+        EXPECT_GE(peak_power[t * K + 1], peak_power[t * K + 2]);
+
+        const double row_max = *std::max_element(power.begin() + t * freq_len, power.begin() + (t + 1) * freq_len);
+        EXPECT_GE(peak_power[t * K], row_max);
+        EXPECT_LT(peak_power[t * K], 1.2 * row_max);
+    }
+
+    spectrogram_destroy(transform);
+
+    // A constant-Q transform of a single bin, which has no neighbours to compare against
+    config.bins_per_octave = 12;
+    config.min_frequency   = 250;
+    config.max_frequency   = 250;
+    transform              = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+    ASSERT_EQ(spectrogram_get_freqlen(transform), 1u);
+
+    const size_t        num_rows = spectrogram_get_timelen(transform);
+    std::vector<double> single_freq(num_rows * 2), single_power(num_rows * 2);
+    spectrogram_get_peaks(transform, 2, 1, single_freq.data(), single_power.data());
+    for (size_t t = 0; t < num_rows; t++) {
+        EXPECT_DOUBLE_EQ(single_freq[t * 2], 250.0);
+        EXPECT_GT(single_power[t * 2], 0.0);
+        EXPECT_EQ(single_freq[t * 2 + 1], 0.0);
+    }
+    spectrogram_destroy(transform);
+
+    // Gated segments of silence, whose floor power would otherwise make a peak at DC, have no peaks
+    std::fill(input.begin() + input.size() / 2, input.end(), 0.0);
+    config.bins_per_octave = 0;
+    config.gate_threshold  = 1e-6;
+    config.gate_floor      = 1.0;
+    config.num_threads     = 2;
+    transform              = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    std::vector<unsigned char> mask(time_len);
+    spectrogram_get_frame_mask(transform, mask.data());
+    spectrogram_get_peaks(transform, K, 3, freq.data(), peak_power.data());
+    ASSERT_EQ(mask.back(), 0);
+    for (size_t t = 0; t < time_len; t++) {
+        if (mask[t]) {
+            EXPECT_NEAR(freq[t * K], tones[0], 0.5);
+        } else {
+            for (size_t peak = 0; peak < K; peak++) {
+                EXPECT_EQ(freq[t * K + peak], 0.0);
+                EXPECT_EQ(peak_power[t * K + peak], 0.0);
+            }
+        }
+    }
+    spectrogram_destroy(transform);
+}
+
+TEST(CrossSpectra, MatchesPowerAndCoherence) {
+    // Channel 1 is channel 0 delayed with independent noise added; channel 2 is unrelated
+    const size_t        num_samples = 20000;
+    std::vector<double> noise       = NoisySignal(num_samples + 40);
+    std::vector<double> channels[3];
+    for (std::vector<double>& channel : channels) {
+        channel.resize(num_samples);
+    }
+    unsigned long state = 99;
+    for (size_t i = 0; i < num_samples; i++) {
+        state          = (state * 1103515245 + 12345) % 2147483648;
+        channels[0][i] = noise[i + 5];
+        channels[1][i] = noise[i] + 0.1 * ((double)state / 2147483648.0 - 0.5);
+        channels[2][i] = (double)((state >> 8) % 1000) / 1000.0 - 0.5;
+    }
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = num_samples;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 128;
+    config.window_overlap   = 64;
+    config.transform_length = 128;
+    config.num_threads      = 2;
+
+    SpectrogramTransform*        transform = spectrogram_create(&props, &config);
+    const size_t                 freq_len  = spectrogram_get_freqlen(transform);
+    const size_t                 time_len  = spectrogram_get_timelen(transform);
+    const void*                  inputs[]  = {channels[0].data(), channels[1].data(), channels[2].data()};
+    const SpectrogramChannelPair pairs[]   = {{0, 0}, {0, 1}, {0, 2}};
+    std::vector<double>          csd(3 * 2 * freq_len), coherence(3 * freq_len), phase(3 * freq_len);
+    spectrogram_get_cross_spectra(transform, inputs, 3, pairs, 3, csd.data(), coherence.data(), phase.data());
+
+    // The auto-spectrum is the averaged power periodogram
+    std::vector<double> periodogram(freq_len);
+    spectrogram_execute(transform, channels[0].data());
+    spectrogram_get_power_periodogram(transform, periodogram.data());
+    for (size_t f = 0; f < freq_len; f++) {
+        EXPECT_NEAR(csd[2 * f], periodogram[f] / time_len, 1e-12 * periodogram[f]);
+        EXPECT_NEAR(csd[2 * f + 1], 0.0, 1e-12 * periodogram[f]);
+        EXPECT_NEAR(coherence[f], 1.0, 1e-12);
+    }
+
+    // Delayed copies are coherent with a linear phase, unrelated signals are not
+    double related = 0, unrelated = 0;
+    for (size_t f = 1; f < freq_len / 2; f++) {
+        related += coherence[freq_len + f] / (freq_len / 2 - 1);
+        unrelated += coherence[2 * freq_len + f] / (freq_len / 2 - 1);
+        EXPECT_NEAR(std::remainder(phase[freq_len + f] - 2.0 * M_PI * f * 5 / 128.0, 2.0 * M_PI), 0.0, 0.5);
+    }
+    EXPECT_GT(related, 0.9);
+    EXPECT_LT(unrelated, 0.1);
+
+    spectrogram_destroy(transform);
+}
+
+TEST(Image, QuantizesDecibels) {
+    std::vector<double> input = NoisySignal(5000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HAMMING;
+    config.window_length    = 64;
+    config.window_overlap   = 32;
+    config.transform_length = 64;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+
+    const size_t time_len = spectrogram_get_timelen(transform);
+    const size_t freq_len = spectrogram_get_freqlen(transform);
+    const double db_min   = -60.0;
+    const double db_max   = 0.0;
+
+    std::vector<double>         power(time_len * freq_len);
+    std::vector<unsigned char>  gray8(time_len * freq_len), rgba(4 * time_len * freq_len);
+    std::vector<unsigned short> gray16(time_len * freq_len);
+    spectrogram_get_power(transform, power.data());
+    spectrogram_get_image(transform, db_min, db_max, IMAGE_GRAY8, gray8.data());
+    spectrogram_get_image(transform, db_min, db_max, IMAGE_GRAY16, gray16.data());
+
+    std::vector<unsigned char> colormap(4 * 256);
+    for (size_t level = 0; level < 256; level++) {
+        colormap[4 * level]     = (unsigned char)level;
+        colormap[4 * level + 1] = (unsigned char)(255 - level);
+        colormap[4 * level + 2] = 7;
+        colormap[4 * level + 3] = 255;
+    }
+    spectrogram_set_colormap(transform, colormap.data());
+    spectrogram_get_image(transform, db_min, db_max, IMAGE_RGBA8, rgba.data());
+
+    // Rows are frequencies from highest to lowest, and may be off by one level where rounding is ambiguous
+    for (size_t t = 0; t < time_len; t++) {
+        for (size_t f = 0; f < freq_len; f++) {
+            const double db    = std::min(std::max(10.0 * log10(power[t * freq_len + f]), db_min), db_max);
+            const double level = (db - db_min) / (db_max - db_min);
+            const size_t pixel = (freq_len - 1 - f) * time_len + t;
+
+            EXPECT_NEAR(gray8[pixel], level * 255, 0.51);
+            EXPECT_NEAR(gray16[pixel], level * 65535, 0.6);
+            EXPECT_EQ(rgba[4 * pixel], gray8[pixel]);
+            EXPECT_EQ(rgba[4 * pixel + 1], 255 - gray8[pixel]);
+        }
+    }
+
+    spectrogram_destroy(transform);
+}
+
+TEST(Periodogram, PercentilesRejectImpulses) {
+    std::vector<double> input = NoisySignal(8000);
+
+    // Loud clicks in a few segments wreck the mean but not the median
+    for (size_t i = 0; i < input.size(); i += 2000) {
+        input[i] = 1000.0;
+    }
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 100;
+    config.window_overlap   = 50;
+    config.transform_length = 128;
+
+    SpectrogramTransform* full  = spectrogram_create(&props, &config);
+    config.max_memory_bytes     = spectrogram_estimate_memory(&props, &config) / 8;
+    SpectrogramTransform* tiled = spectrogram_create(&props, &config);
+    spectrogram_execute(full, input.data());
+    spectrogram_execute(tiled, input.data());
+
+    const size_t        time_len = spectrogram_get_timelen(full);
+    const size_t        freq_len = spectrogram_get_freqlen(full);
+    std::vector<double> power(time_len * freq_len);
+    spectrogram_get_power(full, power.data());
+
+    const double percentiles[] = {0.0, 25.0, 50.0, 90.0, 100.0};
+    for (double percentile : percentiles) {
+        std::vector<double> full_out(freq_len), tiled_out(freq_len), expected(freq_len);
+        spectrogram_get_percentile_periodogram(full, percentile, full_out.data());
+        spectrogram_get_percentile_periodogram(tiled, percentile, tiled_out.data());
+
+        for (size_t f = 0; f < freq_len; f++) {
+            std::vector<double> column(time_len);
+            for (size_t t = 0; t < time_len; t++) {
+                column[t] = power[t * freq_len + f];
+            }
+            std::sort(column.begin(), column.end());
+
+            const double position = percentile / 100.0 * (time_len - 1);
+            const size_t rank     = (size_t)position;
+            const size_t next     = std::min(rank + 1, time_len - 1);
+            expected[f]           = column[rank] + (position - rank) * (column[next] - column[rank]);
+        }
+
+        EXPECT_LT(MaxError(full_out, expected), 1e-12) << percentile;
+        EXPECT_LT(MaxError(tiled_out, expected), 1e-12) << percentile;
+    }
+
+    spectrogram_destroy(full);
+    spectrogram_destroy(tiled);
+
+    // Dense enough that the columns of all bins span several groups
+    config.window_overlap   = 98;
+    config.max_memory_bytes = 0;
+    full                    = spectrogram_create(&props, &config);
+    spectrogram_execute(full, input.data());
+
+    const size_t dense_len = spectrogram_get_timelen(full);
+    ASSERT_GT(dense_len * freq_len * sizeof(double), (size_t)(1 << 20));
+    power.resize(dense_len * freq_len);
+    spectrogram_get_power(full, power.data());
+
+    std::vector<double> maximum(freq_len), expected(freq_len, 0.0);
+    spectrogram_get_percentile_periodogram(full, 100.0, maximum.data());
+    for (size_t t = 0; t < dense_len; t++) {
+        for (size_t f = 0; f < freq_len; f++) {
+            expected[f] = std::max(expected[f], power[t * freq_len + f]);
+        }
+    }
+    EXPECT_EQ(maximum, expected);
+    spectrogram_destroy(full);
+}
+
+TEST(Periodogram, StableAndDeterministic) {
+    // Many short float segments, where summing in float loses precision
+    std::vector<double> noise = NoisySignal(400000);
+    std::vector<float>  input(noise.begin(), noise.end());
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(float);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 16;
+    config.window_overlap   = 8;
+    config.transform_length = 16;
+    config.num_threads      = 1;
+
+    SpectrogramTransform* serial = spectrogram_create(&props, &config);
+    config.num_threads           = 4;
+    config.chunk_frames          = 96;
+    SpectrogramTransform* parallel = spectrogram_create(&props, &config);
+    spectrogram_execute(serial, input.data());
+    spectrogram_execute(parallel, input.data());
+
+    const size_t       time_len = spectrogram_get_timelen(serial);
+    const size_t       freq_len = spectrogram_get_freqlen(serial);
+    std::vector<float> power(time_len * freq_len), serial_out(freq_len), parallel_out(freq_len);
+    spectrogram_get_power(serial, power.data());
+    spectrogram_get_power_periodogram(serial, serial_out.data());
+    spectrogram_get_power_periodogram(parallel, parallel_out.data());
+
+    for (size_t f = 0; f < freq_len; f++) {
+        long double reference = 0.0L;
+        for (size_t t = 0; t < time_len; t++) {
+            reference += power[t * freq_len + f];
+        }
+
+        // Bitwise identical for any thread count and chunking, and within float rounding of the reference
+        EXPECT_EQ(serial_out[f], parallel_out[f]);
+        EXPECT_LT(fabsl(serial_out[f] - reference) / reference, 1e-6L);
+    }
+
+    spectrogram_destroy(serial);
+    spectrogram_destroy(parallel);
+}
+
+TEST(Batch, MatchesSeparateTransforms) {
+    std::vector<double> input = NoisySignal(20000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = 4000;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.padding_mode     = PAD;
+    config.window_type      = HAMMING;
+    config.window_length    = 64;
+    config.window_overlap   = 16;
+    config.transform_length = 64;
+    config.chunk_frames     = 16;
+
+    // Clips of different lengths, including one too short for a segment, cut from the same signal
+    const size_t    lengths[] = {1000, 37, 4321, 0, 64, 2500};
+    const size_t    num_clips = sizeof(lengths) / sizeof(lengths[0]);
+    SpectrogramClip clips[num_clips];
+    size_t          start = 0;
+    for (size_t clip = 0; clip < num_clips; clip++) {
+        clips[clip].data        = input.data() + start;
+        clips[clip].num_samples = lengths[clip];
+        start += lengths[clip];
+    }
+
+    SpectrogramTransform* batch = spectrogram_create(&props, &config);
+    size_t                offsets[num_clips + 1];
+
+    // A second call reuses the buffers of the first
+    spectrogram_execute_batch(batch, clips, 2, NULL);
+    const size_t        num_rows = spectrogram_execute_batch(batch, clips, num_clips, offsets);
+    const size_t        freq_len = spectrogram_get_freqlen(batch);
+    std::vector<double> power(num_rows * freq_len), phase(num_rows * freq_len);
+    spectrogram_get_batch_power_phase(batch, power.data(), phase.data());
+    EXPECT_EQ(offsets[num_clips], num_rows);
+
+    for (size_t clip = 0; clip < num_clips; clip++) {
+        props.num_samples               = lengths[clip];
+        SpectrogramTransform* transform = spectrogram_create(&props, &config);
+        spectrogram_execute(transform, const_cast<void*>(clips[clip].data));
+
+        const size_t time_len = spectrogram_get_timelen(transform);
+        ASSERT_EQ(offsets[clip + 1] - offsets[clip], time_len);
+        if (time_len > 0) {
+            std::vector<double> expected_power(time_len * freq_len), expected_phase(time_len * freq_len);
+            spectrogram_get_power_phase(transform, expected_power.data(), expected_phase.data());
+
+            std::vector<double> clip_power(power.begin() + offsets[clip] * freq_len,
+                                           power.begin() + offsets[clip + 1] * freq_len);
+            std::vector<double> clip_phase(phase.begin() + offsets[clip] * freq_len,
+                                           phase.begin() + offsets[clip + 1] * freq_len);
+            EXPECT_LT(MaxError(clip_power, expected_power), 1e-12);
+            EXPECT_LT(MaxError(clip_phase, expected_phase), 1e-9);
+        }
+
+        spectrogram_destroy(transform);
+    }
+
+    spectrogram_destroy(batch);
+}
+
+TEST(Batch, OddLengthsAcrossManyChunks) {
+    std::vector<double> input = NoisySignal(6000);
+
+    // Three segments of 49 values each, so the chunk of the transform itself is not a multiple of the alignment
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = 99;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_length    = 49;
+    config.window_overlap   = 24;
+    config.transform_length = 49;
+    config.num_threads      = 2;
+
+    const size_t    lengths[] = {2000, 99, 3901};
+    const size_t    num_clips = sizeof(lengths) / sizeof(lengths[0]);
+    SpectrogramClip clips[num_clips];
+    size_t          start = 0;
+    for (size_t clip = 0; clip < num_clips; clip++) {
+        clips[clip].data        = input.data() + start;
+        clips[clip].num_samples = lengths[clip];
+        start += lengths[clip];
+    }
+
+    SpectrogramTransform* batch = spectrogram_create(&props, &config);
+    ASSERT_EQ(spectrogram_get_timelen(batch), 3u);
+
+    size_t              offsets[num_clips + 1];
+    const size_t        num_rows = spectrogram_execute_batch(batch, clips, num_clips, offsets);
+    const size_t        freq_len = spectrogram_get_freqlen(batch);
+    std::vector<double> power(num_rows * freq_len);
+    spectrogram_get_batch_power_phase(batch, power.data(), NULL);
+    EXPECT_GT(num_rows, 100u);
+
+    for (size_t clip = 0; clip < num_clips; clip++) {
+        props.num_samples               = lengths[clip];
+        SpectrogramTransform* transform = spectrogram_create(&props, &config);
+        spectrogram_execute(transform, const_cast<void*>(clips[clip].data));
+
+        const size_t time_len = spectrogram_get_timelen(transform);
+        ASSERT_EQ(offsets[clip + 1] - offsets[clip], time_len);
+        std::vector<double> expected_power(time_len * freq_len);
+        spectrogram_get_power(transform, expected_power.data());
+
+        std::vector<double> clip_power(power.begin() + offsets[clip] * freq_len,
+                                       power.begin() + offsets[clip + 1] * freq_len);
+        EXPECT_LT(MaxError(clip_power, expected_power), 1e-12);
+
+        spectrogram_destroy(transform);
+    }
+
+    spectrogram_destroy(batch);
+}
+
+TEST(ModernApi, MatchesCApi) {
+    const std::vector<double> signal = NoisySignal(3000);
+    std::vector<float>        input(signal.begin(), signal.end());
+
+    SpectrogramConfig config = spectrogram::default_config();
+    config.window_type       = HANN;
+    config.window_length     = 64;
+    config.window_overlap    = 32;
+    config.transform_length  = 64;
+
+    // Ownership moves with the transform
+    spectrogram::Transform<float> first(100, input.size(), config);
+    spectrogram::Transform<float> transform(std::move(first));
+    EXPECT_EQ(first.handle(), nullptr);
+    transform.execute(input);
+
+    const size_t       numel = transform.timelen() * transform.freqlen();
+    std::vector<float> power(numel), phase(numel), expected(numel);
+    transform.power_phase(power, phase);
+    spectrogram_get_power(transform.handle(), expected.data());
+    EXPECT_EQ(power, expected);
+    EXPECT_TRUE(std::equal(power.begin(), power.end(), transform.power_view().begin()));
+    EXPECT_TRUE(std::equal(phase.begin(), phase.end(), transform.phase_view().begin()));
+
+    std::vector<float> time(transform.timelen());
+    spectrogram_get_time(transform.handle(), time.data());
+    EXPECT_EQ(transform.time(), time);
+
+    // Frames read the spectra in place; their phase matches the phase output
+    size_t frame_count = 0;
+    for (spectrogram::Frame<float> frame : transform.frames()) {
+        ASSERT_EQ(frame.size(), transform.freqlen());
+        EXPECT_EQ(frame.time(), time[frame.index()]);
+        for (size_t bin = 1; bin + 1 < frame.size(); bin++) {
+            if (power[frame.index() * frame.size() + bin] > 1e-6f) {
+                EXPECT_NEAR(std::arg(frame[bin]), phase[frame.index() * frame.size() + bin], 1e-4);
+            }
+        }
+        frame_count++;
+    }
+    EXPECT_EQ(frame_count, transform.timelen());
+
+    std::vector<float> small(numel - 1);
+    std::vector<float> empty;
+    EXPECT_THROW(transform.power(small), std::invalid_argument);
+    EXPECT_THROW(transform.power(empty), std::invalid_argument);
+    EXPECT_THROW(transform.phase(empty), std::invalid_argument);
+    EXPECT_THROW(transform.execute(spectrogram::span<const float>(input.data(), 10)), std::invalid_argument);
+}
+
+TEST(Inverse, CepstrumAndAutocorrelation) {
+    const std::vector<double> input = NoisySignal(1000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    // Zero-padded to twice the window, so the autocorrelation is not circular
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_length    = 32;
+    config.window_overlap   = 16;
+    config.transform_length = 64;
+    config.chunk_frames     = 16;
+    config.num_threads      = 2;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, (void*)input.data());
+
+    const size_t        time_len = spectrogram_get_timelen(transform);
+    const size_t        freq_len = spectrogram_get_freqlen(transform);
+    std::vector<double> cepstrum(time_len * freq_len), autocorrelation(time_len * freq_len);
+    spectrogram_get_cepstrum(transform, cepstrum.data());
+    spectrogram_get_autocorrelation(transform, autocorrelation.data());
+
+    // Direct definitions, with the DFT of each segment summed in long double
+    double max_cepstrum_error = 0.0, max_autocorrelation_error = 0.0;
+    for (size_t row = 0; row < time_len; row++) {
+        const double*            segment = input.data() + row * 16;
+        std::vector<long double> log_magnitude(64);
+        for (size_t k = 0; k < 64; k++) {
+            long double real = 0, imag = 0;
+            for (size_t m = 0; m < 32; m++) {
+                real += segment[m] * cosl(2 * M_PI * k * m / 64);
+                imag -= segment[m] * sinl(2 * M_PI * k * m / 64);
+            }
+            log_magnitude[k] = 0.5L * logl(real * real + imag * imag);
+        }
+
+        for (size_t lag = 0; lag < freq_len; lag++) {
+            long double expected_cepstrum = 0, expected_autocorrelation = 0;
+            for (size_t k = 0; k < 64; k++) {
+                expected_cepstrum += log_magnitude[k] * cosl(2 * M_PI * k * lag / 64) / 64;
+            }
+            for (size_t m = 0; m + lag < 32; m++) {
+                expected_autocorrelation += (long double)segment[m] * segment[m + lag];
+            }
+
+            const double cepstrum_error = std::abs(cepstrum[row * freq_len + lag] - (double)expected_cepstrum);
+            const double autocorrelation_error =
+                std::abs(autocorrelation[row * freq_len + lag] - (double)expected_autocorrelation);
+            max_cepstrum_error        = std::max(max_cepstrum_error, cepstrum_error);
+            max_autocorrelation_error = std::max(max_autocorrelation_error, autocorrelation_error);
+        }
+    }
+    EXPECT_LT(max_cepstrum_error, 1e-9);
+    EXPECT_LT(max_autocorrelation_error, 1e-9);
+
+    // Tiled transforms compute the same values a chunk at a time
+    config.max_memory_bytes = spectrogram_estimate_memory(&props, &config) / 4;
+
+    SpectrogramTransform*  tiled = spectrogram_create(&props, &config);
+    SpectrogramSpectraView view;
+    std::vector<double>    tiled_cepstrum(time_len * freq_len);
+    spectrogram_get_spectra_view(tiled, &view);
+    EXPECT_EQ(view.num_rows, 0u);
+    spectrogram_execute(tiled, (void*)input.data());
+    spectrogram_get_cepstrum(tiled, tiled_cepstrum.data());
+    EXPECT_LT(MaxError(tiled_cepstrum, cepstrum), 1e-12);
+
+    spectrogram_destroy(tiled);
+    spectrogram_destroy(transform);
+}
+
+TEST(Preprocessing, MatchesSegmentsPreprocessedSeparately) {
+    // A sine on a ramp, with a partial segment at the end
+    std::vector<double> input(1010);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = 0.01 * i + sin(0.3 * i) + 0.2 * cos(0.05 * i * i / 100.0);
+    }
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.padding_mode     = PAD;
+    config.window_type      = HAMMING;
+    config.window_length    = 64;
+    config.window_overlap   = 40;
+    config.transform_length = 64;
+    config.chunk_frames     = 16;
+    config.planner_rigor    = PLANNER_ESTIMATE;
+    config.detrend          = DETREND_LINEAR;
+    config.pre_emphasis     = 0.97;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+    const size_t        time_len = spectrogram_get_timelen(transform);
+    const size_t        freq_len = spectrogram_get_freqlen(transform);
+    std::vector<double> power(time_len * freq_len);
+    spectrogram_get_power(transform, power.data());
+
+    // Each segment pre-emphasized, detrended by a least-squares fit, and transformed on its own
+    config.detrend      = DETREND_NONE;
+    config.pre_emphasis = 0.0;
+    for (size_t row = 0; row < time_len; row++) {
+        const size_t        start = row * 24;
+        const size_t        n     = std::min((size_t)64, input.size() - start);
+        std::vector<double> segment(64, 0.0);
+        double              mean_index = (n - 1) / 2.0, mean_value = 0.0, covariance = 0.0, variance = 0.0;
+        for (size_t m = 0; m < n; m++) {
+            segment[m] = input[start + m] - 0.97 * ((start + m > 0) ? input[start + m - 1] : 0.0);
+            mean_value += segment[m] / n;
+        }
+        for (size_t m = 0; m < n; m++) {
+            covariance += (m - mean_index) * (segment[m] - mean_value);
+            variance += (m - mean_index) * (m - mean_index);
+        }
+        const double slope = (n > 1) ? covariance / variance : 0.0;
+        for (size_t m = 0; m < n; m++) {
+            segment[m] -= mean_value + slope * (m - mean_index);
+        }
+
+        props.num_samples            = 64;
+        SpectrogramTransform* single = spectrogram_create(&props, &config);
+        std::vector<double>   expected(freq_len);
+        spectrogram_execute(single, segment.data());
+        spectrogram_get_power(single, expected.data());
+
+        const std::vector<double> actual(power.begin() + row * freq_len, power.begin() + (row + 1) * freq_len);
+        EXPECT_LT(MaxError(actual, expected), 1e-9) << "segment " << row;
+        spectrogram_destroy(single);
+    }
+
+    spectrogram_destroy(transform);
+}
+
+TEST(ConstantQ, MatchesDirectCorrelation) {
+    // Two tones at bin centres over noise
+    const double        sample_rate = 1000, min_frequency = 50;
+    std::vector<double> input = NoisySignal(2000);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = 0.1 * input[i] + sin(2 * M_PI * 100 * i / sample_rate) +
+                   0.5 * cos(2 * M_PI * min_frequency * pow(2.0, 31 / 12.0) * i / sample_rate);
+    }
+
+    SpectrogramConfig config = spectrogram::default_config();
+    config.window_length     = 400;
+    config.window_overlap    = 300;
+    config.transform_length  = 512;
+    config.planner_rigor     = PLANNER_ESTIMATE;
+    config.bins_per_octave   = 12;
+    config.min_frequency     = min_frequency;
+    config.max_frequency     = 400;
+
+    spectrogram::Transform<double> transform(sample_rate, input.size(), config);
+    transform.execute(input);
+    ASSERT_EQ(transform.freqlen(), (size_t)37);
+    for (size_t bin = 0; bin < transform.freqlen(); bin++) {
+        EXPECT_NEAR(transform.freq()[bin], min_frequency * pow(2.0, bin / 12.0), 1e-9);
+    }
+
+    std::vector<double> power(transform.timelen() * transform.freqlen());
+    transform.power(power);
+
+    // Each bin correlates its segment with a Hann-windowed complex exponential of Q cycles, centred in the segment
+    const double         quality = 1.0 / (pow(2.0, 1.0 / 12) - 1.0);
+    std::vector<double>  expected(power.size());
+    std::complex<double> tone_coefficient;
+    for (size_t row = 0; row < transform.timelen(); row++) {
+        for (size_t bin = 0; bin < transform.freqlen(); bin++) {
+            const double frequency = transform.freq()[bin];
+            const size_t length    = std::min((size_t)ceil(quality * sample_rate / frequency), (size_t)400);
+            const size_t start     = row * 100 + (400 - length) / 2;
+
+            std::complex<double> sum(0.0, 0.0);
+            double               window_sum = 0.0;
+            for (size_t n = 0; n < length; n++) {
+                const double window = 0.5 - 0.5 * cos(2 * M_PI * n / (length - 1));
+                sum += window * input[start + n] * std::polar(1.0, -2 * M_PI * frequency * n / sample_rate);
+                window_sum += window;
+            }
+            expected[row * transform.freqlen() + bin] = 2.0 * std::norm(sum / window_sum);
+            if (row == 3 && bin == 12) {
+                tone_coefficient = sum / window_sum;
+            }
+        }
+    }
+    EXPECT_LT(MaxError(power, expected), 1e-3);
+
+    // Bins report the mean square of a sinusoid at their centre, and its phase
+    EXPECT_NEAR(power[3 * transform.freqlen() + 12], 0.5, 0.01);
+    EXPECT_NEAR(power[3 * transform.freqlen() + 31], 0.125, 0.01);
+    std::vector<double> phase(power.size());
+    transform.phase(phase);
+    EXPECT_NEAR(phase[3 * transform.freqlen() + 12], std::arg(tone_coefficient), 1e-3);
+
+    // Periodograms summarize the power of each bin across segments
+    std::vector<double> periodogram(transform.freqlen()), maximum(transform.freqlen());
+    spectrogram_get_power_periodogram(transform.handle(), periodogram.data());
+    spectrogram_get_percentile_periodogram(transform.handle(), 100.0, maximum.data());
+    for (size_t bin = 0; bin < transform.freqlen(); bin++) {
+        double total = 0.0, largest = 0.0;
+        for (size_t row = 0; row < transform.timelen(); row++) {
+            total += power[row * transform.freqlen() + bin];
+            largest = std::max(largest, power[row * transform.freqlen() + bin]);
+        }
+        EXPECT_NEAR(periodogram[bin], total, 1e-9 * total) << "bin " << bin;
+        EXPECT_EQ(maximum[bin], largest) << "bin " << bin;
+    }
+
+    // Frames decode the interleaved coefficients
+    SpectrogramSpectraView view;
+    spectrogram_get_spectra_view(transform.handle(), &view);
+    EXPECT_EQ(view.layout, SPECTRA_CONSTANT_Q);
+    EXPECT_EQ(view.row_length, 2 * transform.freqlen());
+    EXPECT_NEAR(std::abs(transform.frames().frame(3)[12] - tone_coefficient), 0.0, 1e-3);
+
+    // Chunked transforms apply the same kernel
+    SpectrogramInput props;
+    props.sample_rate       = sample_rate;
+    props.num_samples       = input.size();
+    props.data_size         = sizeof(double);
+    props.stride            = 1;
+    config.max_memory_bytes = spectrogram_estimate_memory(&props, &config) / 4;
+
+    spectrogram::Transform<double> tiled(sample_rate, input.size(), config);
+    std::vector<double>            tiled_power(power.size());
+    tiled.execute(input);
+    tiled.power(tiled_power);
+    EXPECT_LT(MaxError(tiled_power, power), 1e-12);
+}
+
+TEST(Resampling, DecimatedMatchesLowRateSignal) {
+    // A 2 Hz tone sampled at 256 Hz with a 100 Hz tone on top, which would alias to 4 Hz without filtering
+    const double        sample_rate = 256, low_rate = 16;
+    std::vector<double> input(64 * 256), expected_input(64 * 16);
+    for (size_t i = 0; i < input.size(); i++) {
+        input[i] = sin(2 * M_PI * 2 * i / sample_rate) + sin(2 * M_PI * 100 * i / sample_rate);
+    }
+    for (size_t i = 0; i < expected_input.size(); i++) {
+        expected_input[i] = sin(2 * M_PI * 2 * i / low_rate);
+    }
+
+    SpectrogramConfig config = spectrogram::default_config();
+    config.window_type       = HANN;
+    config.window_length     = 64;
+    config.window_overlap    = 32;
+    config.transform_length  = 64;
+
+    spectrogram::Transform<double> expected(low_rate, expected_input.size(), config);
+    config.decimation = 16;
+    spectrogram::Transform<double> decimated(sample_rate, input.size(), config);
+    EXPECT_EQ(decimated.time(), expected.time());
+    EXPECT_EQ(decimated.freq(), expected.freq());
+
+    expected.execute(expected_input);
+    decimated.execute(input);
+    const size_t  freq_len  = expected.freqlen();
+    const double* power     = decimated.power_view().data();
+    const double* power_ref = expected.power_view().data();
+    const double  peak      = *std::max_element(power_ref, power_ref + expected.timelen() * freq_len);
+    double        max_error = 0.0;
+
+    // Away from the ends, where the filter reaches past the signal
+    for (size_t row = 1; row + 1 < expected.timelen(); row++) {
+        for (size_t bin = 0; bin < freq_len; bin++) {
+            max_error = std::max(max_error, std::abs(power[row * freq_len + bin] - power_ref[row * freq_len + bin]));
+        }
+    }
+    EXPECT_LT(max_error, 1e-3 * peak);
+
+    // A rational factor of 3 / 4 puts the axes at 192 Hz
+    config.decimation    = 4;
+    config.interpolation = 3;
+    spectrogram::Transform<double> resampled(sample_rate, input.size(), config);
+    resampled.execute(input);
+    EXPECT_DOUBLE_EQ(resampled.freq().back(), 96.0);
+    EXPECT_EQ(resampled.timelen(), (input.size() * 3 / 4 - 32) / 32);
+}
+
+TEST(Resampling, ChunksMatchWholeSignal) {
+    // Strided input resampled by 3 / 4 a chunk at a time, against a contiguous copy resampled in a single chunk
+    std::vector<double> interleaved = NoisySignal(2 * 6000);
+    std::vector<double> contiguous(interleaved.size() / 2);
+    for (size_t i = 0; i < contiguous.size(); i++) {
+        contiguous[i] = interleaved[2 * i];
+    }
+    const size_t num_samples = contiguous.size();
+
+    SpectrogramInput props;
+    props.sample_rate = 256;
+    props.num_samples = num_samples;
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_length    = 100;
+    config.window_overlap   = 60;
+    config.transform_length = 128;
+    config.chunk_frames     = num_samples;
+    config.planner_rigor    = PLANNER_ESTIMATE;
+    config.pre_emphasis     = 0.9;
+    config.interpolation    = 3;
+    config.decimation       = 4;
+    const std::vector<double> expected = ComputePower(props, config, contiguous);
+
+    props.stride        = 2;
+    config.chunk_frames = 16;
+    config.num_threads  = 3;
+    std::vector<double> power(expected.size());
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, interleaved.data());
+    spectrogram_get_power(transform, power.data());
+    EXPECT_LT(MaxError(power, expected), 1e-12);
+    spectrogram_destroy(transform);
+
+    // Tiled, for the whole signal and for range queries
+    config.max_memory_bytes = spectrogram_estimate_memory(&props, &config) / 8;
+    transform               = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, interleaved.data());
+    spectrogram_get_power(transform, power.data());
+    EXPECT_LT(MaxError(power, expected), 1e-12);
+
+    std::fill(power.begin(), power.end(), 0.0);
+    spectrogram_bind(transform, interleaved.data());
+    spectrogram_get_power_range(transform, 0.0, num_samples / 256.0, power.data());
+    EXPECT_LT(MaxError(power, expected), 1e-12);
+    spectrogram_destroy(transform);
+
+    // A batch of the signal on its own
+    config.max_memory_bytes = 0;
+    transform               = spectrogram_create(&props, &config);
+    SpectrogramClip clip;
+    clip.data        = interleaved.data();
+    clip.num_samples = num_samples;
+    ASSERT_EQ(spectrogram_execute_batch(transform, &clip, 1, NULL), spectrogram_get_timelen(transform));
+    spectrogram_get_batch_power_phase(transform, power.data(), NULL);
+    EXPECT_LT(MaxError(power, expected), 1e-12);
+    spectrogram_destroy(transform);
+}
+
+TEST(FFTBackends, BuiltinMatchesDefault) {
+    // Powers of two, mixed radices, odd lengths and large primes, over more frames than a batch with a partial tail
+    for (size_t length : {8, 49, 60, 64, 97, 125, 194}) {
+        const std::vector<double> input = NoisySignal(20 * length);
+
+        SpectrogramInput props;
+        props.sample_rate = 100;
+        props.num_samples = input.size();
+        props.data_size   = sizeof(double);
+        props.stride      = 1;
+
+        SpectrogramConfig config;
+        spectrogram_init_config(&config);
+        config.window_length    = length;
+        config.window_overlap   = length / 2;
+        config.transform_length = length;
+        config.chunk_frames     = 11;
+
+        SpectrogramTransform* expected = spectrogram_create(&props, &config);
+        config.fft_backend             = FFT_BACKEND_BUILTIN;
+        SpectrogramTransform* builtin  = spectrogram_create(&props, &config);
+        ASSERT_EQ(spectrogram_get_fft_backend(builtin), FFT_BACKEND_BUILTIN);
+        spectrogram_execute(expected, (void*)input.data());
+        spectrogram_execute(builtin, (void*)input.data());
+
+        SpectrogramSpectraView view, view_ref;
+        spectrogram_get_spectra_view(builtin, &view);
+        spectrogram_get_spectra_view(expected, &view_ref);
+        ASSERT_EQ(view.num_rows, view_ref.num_rows);
+
+        double peak = 0.0, max_error = 0.0;
+        for (size_t row = 0; row < view.num_rows; row++) {
+            const double* spectrum     = (const double*)view.data + row * view.row_pitch;
+            const double* spectrum_ref = (const double*)view_ref.data + row * view_ref.row_pitch;
+            for (size_t k = 0; k < length; k++) {
+                peak      = std::max(peak, std::abs(spectrum_ref[k]));
+                max_error = std::max(max_error, std::abs(spectrum[k] - spectrum_ref[k]));
+            }
+        }
+        EXPECT_LT(max_error, 1e-12 * peak) << "length " << length;
+
+        // Inverse transforms, back from the spectra
+        const size_t        num_values = spectrogram_get_timelen(builtin) * spectrogram_get_freqlen(builtin);
+        std::vector<double> autocorrelation(num_values), autocorrelation_ref(num_values);
+        spectrogram_get_autocorrelation(builtin, autocorrelation.data());
+        spectrogram_get_autocorrelation(expected, autocorrelation_ref.data());
+        EXPECT_LT(MaxError(autocorrelation, autocorrelation_ref), 1e-10 * autocorrelation_ref[0]) << "length " << length;
+
+        spectrogram_destroy(expected);
+        spectrogram_destroy(builtin);
+    }
+
+    // Single precision, against the double precision transform
+    const std::vector<double> signal = NoisySignal(1200);
+    const std::vector<float>  input(signal.begin(), signal.end());
+
+    SpectrogramConfig config = spectrogram::default_config();
+    config.window_type       = HANN;
+    config.window_length     = 60;
+    config.window_overlap    = 30;
+    config.transform_length  = 60;
+    config.fft_backend       = FFT_BACKEND_BUILTIN;
+
+    spectrogram::Transform<float>  single(100, input.size(), config);
+    spectrogram::Transform<double> reference(100, signal.size(), config);
+    single.execute(input);
+    reference.execute(signal);
+
+    const size_t  num_values = reference.timelen() * reference.freqlen();
+    const float*  power      = single.power_view().data();
+    const double* power_ref  = reference.power_view().data();
+    const double  peak       = *std::max_element(power_ref, power_ref + num_values);
+    double        max_error  = 0.0;
+    for (size_t i = 0; i < num_values; i++) {
+        max_error = std::max(max_error, std::abs(power[i] - power_ref[i]));
+    }
+    EXPECT_LT(max_error, 1e-5 * peak);
+}
+
+TEST(Realtime, CallbacksMatchOfflineTransform) {
+    // 64-sample callbacks, each completing one segment
+    const size_t              callback_samples = 64;
+    const size_t              num_callbacks    = 400;
+    const std::vector<double> input            = NoisySignal(callback_samples * num_callbacks);
+
+    SpectrogramInput props;
+    props.sample_rate = 48000;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 256;
+    config.window_overlap   = 192;
+    config.transform_length = 256;
+    config.fft_backend      = FFT_BACKEND_BUILTIN;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, (void*)input.data());
+    const size_t        freq_len   = spectrogram_get_freqlen(transform);
+    const size_t        num_frames = (input.size() - 256) / 64 + 1;
+    std::vector<double> expected(spectrogram_get_timelen(transform) * freq_len);
+    spectrogram_get_power(transform, expected.data());
+
+    // Latency of each push, in power-of-two buckets of microseconds, recorded by the producer without allocating
+    SpectrogramRealtime* realtime = spectrogram_realtime_create(transform, num_frames);
+    ASSERT_NE(realtime, (SpectrogramRealtime*)NULL);
+    size_t histogram[24] = {0};
+    size_t completed     = 0;
+
+    std::thread producer([&]() {
+        for (size_t callback = 0; callback < num_callbacks; callback++) {
+            const auto start = std::chrono::steady_clock::now();
+            completed += spectrogram_realtime_push(transform, realtime, input.data() + callback * callback_samples,
+                                                   callback_samples);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+
+            size_t bucket = 0;
+            for (auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(); us > 0; us /= 2) {
+                bucket++;
+            }
+            histogram[std::min(bucket, (size_t)23)]++;
+        }
+    });
+
+    std::vector<double> received(num_frames * freq_len);
+    size_t              num_received = 0, frame = 0;
+    bool                in_order     = true;
+    while (num_received < num_frames) {
+        if (spectrogram_realtime_pop(transform, realtime, received.data() + num_received * freq_len, &frame)) {
+            in_order = in_order && frame == num_received;
+            num_received++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    EXPECT_EQ(completed, num_frames);
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(spectrogram_realtime_dropped(transform, realtime), 0u);
+    EXPECT_LT(MaxError(received, std::vector<double>(expected.begin(), expected.begin() + received.size())), 1e-12);
+
+    // Record the histogram, and check the typical push fits well within the 1.3 ms between 64-sample callbacks
+    size_t counted = 0, median_bucket = 0;
+    for (size_t bucket = 0; bucket < 24; bucket++) {
+        if (histogram[bucket] > 0) {
+            RecordProperty("push_latency_below_" + std::to_string((size_t)1 << bucket) + "us", (int)histogram[bucket]);
+        }
+        if (counted < num_callbacks / 2 && counted + histogram[bucket] >= num_callbacks / 2) {
+            median_bucket = bucket;
+        }
+        counted += histogram[bucket];
+    }
+    EXPECT_EQ(counted, num_callbacks);
+    EXPECT_LE((size_t)1 << median_bucket, 1024u);
+
+    // The worst push, the highest non-empty bucket, may include preemption of the producer, so it is only held to a
+    // few callback periods
+    size_t max_bucket = 23;
+    while (max_bucket > 0 && histogram[max_bucket] == 0) {
+        max_bucket--;
+    }
+    RecordProperty("push_latency_max_below_us", (int)((size_t)1 << max_bucket));
+    EXPECT_LE((size_t)1 << max_bucket, 4096u);
+    spectrogram_realtime_destroy(transform, realtime);
+
+    // Without a consumer, segments past the queue's capacity are dropped and the queued ones are kept
+    realtime = spectrogram_realtime_create(transform, 8);
+    EXPECT_EQ(spectrogram_realtime_push(transform, realtime, input.data(), input.size()), num_frames);
+    EXPECT_EQ(spectrogram_realtime_dropped(transform, realtime), num_frames - 8);
+
+    std::vector<double> power(freq_len);
+    for (size_t row = 0; row < 8; row++) {
+        ASSERT_EQ(spectrogram_realtime_pop(transform, realtime, power.data(), &frame), 1);
+        EXPECT_EQ(frame, row);
+        EXPECT_LT(MaxError(power, std::vector<double>(expected.begin() + row * freq_len,
+                                                     expected.begin() + (row + 1) * freq_len)),
+                  1e-12);
+    }
+    EXPECT_EQ(spectrogram_realtime_pop(transform, realtime, power.data(), &frame), 0);
+
+    spectrogram_realtime_destroy(transform, realtime);
+    spectrogram_destroy(transform);
+}
+
+#ifdef WITH_DAEMON
+TEST(Daemon, MatchesLocalTransform) {
+    const std::string socket_path = "/tmp/spectrogramd-test-" + std::to_string(getpid()) + ".sock";
+    Server            server(socket_path, "", 4);
+    ASSERT_TRUE(server.start());
+
+    SpectrogramClient* client = spectrogram_client_connect(socket_path.c_str(), 1 << 20);
+    ASSERT_TRUE(client != NULL);
+
+    std::vector<double> input = NoisySignal(5000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_type      = HANN;
+    config.window_length    = 128;
+    config.window_overlap   = 64;
+    config.transform_length = 128;
+
+    size_t time_len, freq_len;
+    ASSERT_EQ(spectrogram_client_query(client, &props, &config, &time_len, &freq_len), CLIENT_OK);
+
+    // Signal first, then the power and phase
+    char*        arena        = (char*)spectrogram_client_arena(client);
+    const size_t numel        = time_len * freq_len;
+    const size_t power_offset = input.size() * sizeof(double);
+    const size_t phase_offset = power_offset + numel * sizeof(double);
+    memcpy(arena, input.data(), power_offset);
+
+    // Twice, the second time with a warm transform
+    for (int job = 0; job < 2; job++) {
+        ASSERT_EQ(spectrogram_client_execute(client, &props, &config, 0, power_offset, phase_offset), CLIENT_OK);
+    }
+    EXPECT_EQ(spectrogram_client_execute(client, &props, &config, 0, spectrogram_client_arena_size(client),
+                                         SPECTROGRAM_NO_OUTPUT),
+              CLIENT_OUT_OF_BOUNDS);
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+    std::vector<double> expected_power(numel), expected_phase(numel);
+    spectrogram_get_power_phase(transform, expected_power.data(), expected_phase.data());
+
+    std::vector<double> power((double*)(arena + power_offset), (double*)(arena + power_offset) + numel);
+    std::vector<double> phase((double*)(arena + phase_offset), (double*)(arena + phase_offset) + numel);
+    EXPECT_EQ(MaxError(power, expected_power), 0.0);
+    EXPECT_EQ(MaxError(phase, expected_phase), 0.0);
+
+    spectrogram_destroy(transform);
+    spectrogram_client_disconnect(client);
+    server.stop();
+}
+TEST(Daemon, ConcurrentClientsShareTransform) {
+    const std::string socket_path = "/tmp/spectrogramd-test-" + std::to_string(getpid()) + "-shared.sock";
+    Server            server(socket_path, "", 4);
+    ASSERT_TRUE(server.start());
+
+    std::vector<double> input = NoisySignal(5000);
+
+    SpectrogramInput props;
+    props.sample_rate = 100;
+    props.num_samples = input.size();
+    props.data_size   = sizeof(double);
+    props.stride      = 1;
+
+    SpectrogramConfig config;
+    spectrogram_init_config(&config);
+    config.window_length    = 128;
+    config.window_overlap   = 64;
+    config.transform_length = 128;
+
+    SpectrogramTransform* transform = spectrogram_create(&props, &config);
+    spectrogram_execute(transform, input.data());
+    const size_t        numel = spectrogram_get_timelen(transform) * spectrogram_get_freqlen(transform);
+    std::vector<double> expected(numel);
+    spectrogram_get_power(transform, expected.data());
+    spectrogram_destroy(transform);
+
+    // Each client repeatedly runs the same job, executing at the same time as the other on one warm transform
+    const size_t             num_clients = 2;
+    std::vector<double>      errors(num_clients, -1);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < num_clients; c++) {
+        clients.emplace_back([&, c]() {
+            SpectrogramClient* client = spectrogram_client_connect(socket_path.c_str(), 1 << 20);
+            if (client == NULL) {
+                return;
+            }
+            char*        arena        = (char*)spectrogram_client_arena(client);
+            const size_t power_offset = input.size() * sizeof(double);
+            memcpy(arena, input.data(), power_offset);
+
+            double error = 0;
+            for (int job = 0; job < 8; job++) {
+                memset(arena + power_offset, 0, numel * sizeof(double));
+                if (spectrogram_client_execute(client, &props, &config, 0, power_offset, SPECTROGRAM_NO_OUTPUT) !=
+                    CLIENT_OK) {
+                    error = INFINITY;
+                    break;
+                }
+                std::vector<double> power((double*)(arena + power_offset),
+                                          (double*)(arena + power_offset) + numel);
+                error = std::max(error, MaxError(power, expected));
+            }
+            errors[c] = error;
+            spectrogram_client_disconnect(client);
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+
+    for (size_t c = 0; c < num_clients; c++) {
+        EXPECT_EQ(errors[c], 0.0) << "client " << c;
+    }
+    server.stop();
+}
+#endif